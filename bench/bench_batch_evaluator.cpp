@@ -0,0 +1,48 @@
+#include "sync_calculator/batch_evaluator.hpp"
+#include "sync_calculator/evaluator.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+// same shape as Requester::do_request, mixed with `a*b`
+static std::vector<std::string> make_frames(size_t n) {
+  std::mt19937 rand(0);
+  std::uniform_int_distribution<int> dist(0, 1 << 20);
+  std::vector<std::string> frames;
+  frames.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    frames.emplace_back(
+        fmt::format("{}{}{}", dist(rand), i % 2 ? '*' : '+', dist(rand)));
+  }
+  return frames;
+}
+
+static void BM_parser_per_frame(benchmark::State &state) {
+  auto frames = make_frames(state.range(0));
+  for (auto _ : state) {
+    for (const auto &frame : frames) {
+      benchmark::DoNotOptimize(evaluate(frame));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * frames.size());
+}
+
+static void BM_batch_evaluator(benchmark::State &state) {
+  auto frames = make_frames(state.range(0));
+  BatchEvaluator batch;
+  for (auto _ : state) {
+    for (const auto &frame : frames) {
+      batch.push(frame);
+    }
+    benchmark::DoNotOptimize(batch.flush().data());
+  }
+  state.SetItemsProcessed(state.iterations() * frames.size());
+}
+
+BENCHMARK(BM_parser_per_frame)->RangeMultiplier(4)->Range(16, 4096);
+BENCHMARK(BM_batch_evaluator)->RangeMultiplier(4)->Range(16, 4096);
+
+BENCHMARK_MAIN();
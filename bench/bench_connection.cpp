@@ -0,0 +1,183 @@
+#include "sync_calculator/codec.hpp"
+#include "utils/buffer.hpp"
+#include "utils/common.hpp"
+#include "utils/connection.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <queue>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+// Server side framing cost of Connection<Codec, Buffer> against the hand
+// written Responser it replaced. Requests are pre-encoded and pushed through
+// a socketpair, the evaluation is replaced by a trivial one, so that only
+// buffering, framing and encoding are measured.
+
+namespace legacy {
+
+// Responser::do_read / do_write before Connection, kept verbatim apart from
+// the parser call
+class Responser {
+public:
+  Responser(int sock_fd) : sock_fd(sock_fd) {}
+
+  void do_write() {
+    if (responses.empty()) {
+      return;
+    }
+    char *data_ptr = send_buffer.data() + send_buffer_bytes_written;
+    while (send_buffer_bytes_available > 0 && !responses.empty()) {
+      auto response = responses.front();
+      std::string response_body = fmt::format("{}", response);
+      size_t packet_size = header_size + response_body.size();
+      if (packet_size > send_buffer_bytes_available) {
+        break;
+      }
+      responses.pop();
+      memcpy(data_ptr + header_size, response_body.data(),
+             response_body.size());
+      set_content_size(data_ptr,
+                       {static_cast<uint16_t>(response_body.size())});
+      data_ptr += packet_size;
+      send_buffer_bytes_available -= packet_size;
+      send_buffer_bytes_written += packet_size;
+    }
+    ssize_t bytes_written =
+        write(sock_fd, send_buffer.data(), send_buffer_bytes_written);
+    if (bytes_written == -1) {
+      int _errno = errno;
+      if (would_block(errno)) {
+        return;
+      }
+      throw send_error(get_errno_string(_errno));
+    }
+    DEBUG("send: {}",
+          escaped(std::string_view(send_buffer.data(), bytes_written)));
+    std::copy(send_buffer.data() + bytes_written,
+              send_buffer.data() + send_buffer_bytes_written,
+              send_buffer.data());
+    send_buffer_bytes_available += bytes_written;
+    send_buffer_bytes_written -= bytes_written;
+  }
+
+  void do_read() {
+    int bytes_received;
+    bytes_received =
+        read(sock_fd, recv_buffer.data() + recv_buffer_bytes_written,
+             recv_buffer_bytes_available);
+    if (bytes_received == 0) {
+      throw eof_error();
+    } else if (bytes_received == -1) {
+      if (would_block(errno)) {
+        return;
+      }
+      throw recv_error(get_errno_string(errno));
+    }
+    DEBUG("recv: {}", escaped(std::string_view(recv_buffer.data() +
+                                                   recv_buffer_bytes_written,
+                                               bytes_received)));
+    char *data_ptr = recv_buffer.data();
+    bytes_received += recv_buffer_bytes_written;
+    while (bytes_received > 0) {
+      if (bytes_received < static_cast<int>(header_size)) {
+        std::copy(data_ptr, data_ptr + bytes_received, recv_buffer.data());
+        break;
+      }
+      uint16_t data_size = get_content_size(data_ptr).size;
+      size_t packet_size = data_size + header_size;
+      if (packet_size > static_cast<size_t>(bytes_received)) {
+        std::copy(data_ptr, data_ptr + bytes_received, recv_buffer.data());
+        break;
+      }
+      std::string_view packet_data(data_ptr + header_size, data_size);
+      responses.emplace(stoi(packet_data.substr(0, 3)));
+      data_ptr += packet_size;
+      bytes_received -= packet_size;
+    }
+    recv_buffer_bytes_written = bytes_received;
+    recv_buffer_bytes_available = recv_buffer.size() - bytes_received;
+  }
+
+private:
+  int sock_fd{};
+  std::array<char, 1024> send_buffer{};
+  std::array<char, 1024> recv_buffer{};
+  std::queue<int> responses{};
+  size_t send_buffer_bytes_written = 0;
+  size_t send_buffer_bytes_available = send_buffer.size();
+  size_t recv_buffer_bytes_written = 0;
+  size_t recv_buffer_bytes_available = recv_buffer.size();
+};
+
+} // namespace legacy
+
+template <typename Codec> class Responser {
+public:
+  Responser(int sock_fd) : connection(sock_fd) {}
+
+  void do_write() { connection.write(responses); }
+  void do_read() {
+    connection.template read<std::string_view>(
+        [this](std::string_view request) {
+          responses.push({stoi(request.substr(0, 3))});
+        });
+  }
+
+private:
+  Connection<Codec, FixedBuffer<1024>> connection{};
+  std::queue<ResponseData> responses{};
+};
+
+// `n` requests encoded with `Codec`, in chunks that fit into the 1 KiB
+// receive buffer
+template <typename Codec>
+static std::vector<std::string> encode_requests(size_t n) {
+  std::vector<std::string> expressions;
+  for (size_t i = 0; i < n; i++) {
+    expressions.push_back(fmt::format("{}+{}", 100000 + i, i));
+  }
+  std::queue<RequestData> requests;
+  for (const auto &expression : expressions) {
+    requests.push({expression});
+  }
+  std::vector<std::string> chunks;
+  std::array<char, 1024> buffer;
+  while (!requests.empty()) {
+    size_t size = Codec::encode(buffer.data(), buffer.size(), requests);
+    chunks.emplace_back(buffer.data(), size);
+  }
+  return chunks;
+}
+
+template <typename Server, typename Codec>
+static void run(benchmark::State &state) {
+  int fds[2];
+  CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  set_fd_status_flag(fds[0], O_NONBLOCK);
+  set_fd_status_flag(fds[1], O_NONBLOCK);
+  Server server(fds[1]);
+  auto chunks = encode_requests<Codec>(state.range(0));
+  std::array<char, 1 << 16> sink;
+  for (auto _ : state) {
+    for (const auto &chunk : chunks) {
+      CHECK(write(fds[0], chunk.data(), chunk.size()));
+      server.do_read();
+      server.do_write();
+      while (read(fds[0], sink.data(), sink.size()) > 0) {
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  close(fds[0]);
+  close(fds[1]);
+}
+
+BENCHMARK(run<legacy::Responser, TextCodec>)->Arg(64)->Arg(1024);
+BENCHMARK(run<Responser<TextCodec>, TextCodec>)->Arg(64)->Arg(1024);
+BENCHMARK(run<Responser<BinaryCodec>, BinaryCodec>)->Arg(64)->Arg(1024);
+BENCHMARK(run<Responser<BatchCodec>, BatchCodec>)->Arg(64)->Arg(1024);
+
+BENCHMARK_MAIN();
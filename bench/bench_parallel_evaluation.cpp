@@ -0,0 +1,55 @@
+#include "sync_calculator/evaluator.hpp"
+
+#include <random>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+// sum of `n_terms` products, e.g. `3*7+12*(4+1)+...`
+static std::string make_expression(size_t n_terms) {
+  std::mt19937 rand(0);
+  std::uniform_int_distribution<int> dist(0, 1 << 10);
+  std::string expression;
+  for (size_t i = 0; i < n_terms; i++) {
+    if (i != 0) {
+      expression += '+';
+    }
+    if (i % 3 == 0) {
+      expression += fmt::format("{}*({}+{})", dist(rand), dist(rand),
+                                dist(rand));
+    } else {
+      expression += fmt::format("{}*{}", dist(rand), dist(rand));
+    }
+  }
+  return expression;
+}
+
+static void BM_sequential(benchmark::State &state) {
+  set_parallel_evaluation(0, 0);
+  auto expression = make_expression(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(evaluate(expression));
+  }
+  state.SetBytesProcessed(state.iterations() * expression.size());
+}
+
+static void BM_parallel(benchmark::State &state) {
+  set_parallel_evaluation(1, state.range(1));
+  auto expression = make_expression(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(evaluate(expression));
+  }
+  state.SetBytesProcessed(state.iterations() * expression.size());
+  set_parallel_evaluation(0, 0);
+}
+
+BENCHMARK(BM_sequential)
+    ->RangeMultiplier(8)
+    ->Range(64, 1 << 18)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_parallel)
+    ->ArgsProduct({benchmark::CreateRange(64, 1 << 18, 8), {2, 4, 8}})
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,238 @@
+#include "sync_calculator/codec.hpp"
+#include "sync_calculator/responser.hpp"
+#include "utils/buffer.hpp"
+#include "utils/common.hpp"
+#include "utils/connection.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <charconv>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+// The building blocks of the request path on their own: framing headers,
+// splitting a read into frames, number parsing and formatting, and the
+// parser behind Responser::do_response. Socket I/O goes through a
+// socketpair, so that no network stack is involved.
+
+// random numbers of `digits` decimal digits, as text
+static std::vector<std::string> make_numbers(size_t n, int digits) {
+  std::mt19937 rand(0);
+  std::uniform_int_distribution<int> digit(0, 9);
+  std::vector<std::string> numbers(n);
+  for (auto &number : numbers) {
+    number.push_back('1' + digit(rand) % 9);
+    for (int i = 1; i < digits; i++) {
+      number.push_back('0' + digit(rand));
+    }
+  }
+  return numbers;
+}
+
+static void BM_set_content_size(benchmark::State &state) {
+  std::array<char, header_size * 1024> buffer;
+  benchmark::DoNotOptimize(buffer.data());
+  for (auto _ : state) {
+    for (size_t i = 0; i < 1024; i++) {
+      set_content_size(buffer.data() + i * header_size,
+                       {static_cast<uint16_t>(i)});
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * 1024);
+}
+
+static void BM_get_content_size(benchmark::State &state) {
+  std::array<char, header_size * 1024> buffer;
+  for (size_t i = 0; i < 1024; i++) {
+    set_content_size(buffer.data() + i * header_size,
+                     {static_cast<uint16_t>(i)});
+  }
+  for (auto _ : state) {
+    size_t sum = 0;
+    for (size_t i = 0; i < 1024; i++) {
+      sum += get_content_size(buffer.data() + i * header_size).size;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * 1024);
+}
+
+// a 1 KiB receive buffer full of frames with bodies of state.range(0) bytes
+static std::string make_frames(size_t body_size) {
+  std::string frames;
+  std::string body(body_size, '7');
+  while (frames.size() + header_size + body_size <= 1024) {
+    std::array<char, header_size> header;
+    set_content_size(header.data(), {static_cast<uint16_t>(body_size)});
+    frames.append(header.data(), header_size);
+    frames.append(body);
+  }
+  return frames;
+}
+
+static void BM_decode_frames(benchmark::State &state) {
+  std::string frames = make_frames(state.range(0));
+  size_t n_frames = 0;
+  for (auto _ : state) {
+    size_t consumed = codec::decode_frames(
+        frames, [&](std::string_view body) { benchmark::DoNotOptimize(body); });
+    benchmark::DoNotOptimize(consumed);
+    n_frames += frames.size() / (header_size + state.range(0));
+  }
+  state.SetItemsProcessed(n_frames);
+  state.SetBytesProcessed(state.iterations() * frames.size());
+}
+
+// what Responser::do_read does before evaluating: one read() of a socket and
+// splitting it into frames
+static void BM_connection_read(benchmark::State &state) {
+  int fds[2];
+  CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  set_fd_status_flag(fds[1], O_NONBLOCK);
+  Connection<TextCodec, FixedBuffer<1024>> connection(fds[1]);
+  std::string frames = make_frames(state.range(0));
+  size_t n_frames = 0;
+  for (auto _ : state) {
+    CHECK(write(fds[0], frames.data(), frames.size()));
+    connection.read<std::string_view>([&](std::string_view body) {
+      benchmark::DoNotOptimize(body);
+      n_frames++;
+    });
+  }
+  state.SetItemsProcessed(n_frames);
+  state.SetBytesProcessed(state.iterations() * frames.size());
+  close(fds[0]);
+  close(fds[1]);
+}
+
+static void BM_stoi(benchmark::State &state) {
+  auto numbers = make_numbers(1024, state.range(0));
+  for (auto _ : state) {
+    for (const auto &number : numbers) {
+      benchmark::DoNotOptimize(stoi(std::string_view(number)));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * numbers.size());
+}
+
+static void BM_std_stoi(benchmark::State &state) {
+  auto numbers = make_numbers(1024, state.range(0));
+  for (auto _ : state) {
+    for (const auto &number : numbers) {
+      benchmark::DoNotOptimize(std::stoi(number));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * numbers.size());
+}
+
+static void BM_from_chars(benchmark::State &state) {
+  auto numbers = make_numbers(1024, state.range(0));
+  for (auto _ : state) {
+    for (const auto &number : numbers) {
+      int value;
+      std::from_chars(number.data(), number.data() + number.size(), value);
+      benchmark::DoNotOptimize(value);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * numbers.size());
+}
+
+static std::vector<int> make_values() {
+  std::mt19937 rand(0);
+  std::uniform_int_distribution<int> dist(-(1 << 30), 1 << 30);
+  std::vector<int> values(1024);
+  for (auto &value : values) {
+    value = dist(rand);
+  }
+  return values;
+}
+
+// how the response body was formatted before Connection
+static void BM_fmt_format(benchmark::State &state) {
+  auto values = make_values();
+  for (auto _ : state) {
+    for (int value : values) {
+      std::string body = fmt::format("{}", value);
+      benchmark::DoNotOptimize(body.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+
+// codec::format_text, formatting in place into the send buffer
+static void BM_format_to_n(benchmark::State &state) {
+  auto values = make_values();
+  std::array<char, 16> out;
+  for (auto _ : state) {
+    for (int value : values) {
+      benchmark::DoNotOptimize(
+          codec::format_text(out.data(), out.size(), ResponseData{value}));
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+
+static void BM_to_chars(benchmark::State &state) {
+  auto values = make_values();
+  std::array<char, 16> out;
+  for (auto _ : state) {
+    for (int value : values) {
+      benchmark::DoNotOptimize(
+          std::to_chars(out.data(), out.data() + out.size(), value).ptr);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+
+// an expression of about `size` bytes mixing `+` and `*`
+static std::string make_expression(size_t size) {
+  auto numbers = make_numbers(size / 4 + 1, 3);
+  std::string expression = numbers[0];
+  for (size_t i = 1; expression.size() + 4 <= size; i++) {
+    expression.push_back(i % 3 == 0 ? '*' : '+');
+    expression.append(numbers[i]);
+  }
+  return expression;
+}
+
+static void BM_do_response(benchmark::State &state) {
+  int fds[2];
+  CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  set_fd_status_flag(fds[0], O_NONBLOCK);
+  set_fd_status_flag(fds[1], O_NONBLOCK);
+  Responser responser(fds[1]);
+  std::string expression = make_expression(state.range(0));
+  std::array<char, 1024> sink;
+  for (auto _ : state) {
+    responser.do_response(expression);
+    responser.do_write();
+    while (read(fds[0], sink.data(), sink.size()) > 0) {
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * expression.size());
+  close(fds[0]);
+  close(fds[1]);
+}
+
+BENCHMARK(BM_set_content_size);
+BENCHMARK(BM_get_content_size);
+BENCHMARK(BM_decode_frames)->Arg(4)->Arg(16)->Arg(128);
+BENCHMARK(BM_connection_read)->Arg(4)->Arg(16)->Arg(128);
+BENCHMARK(BM_stoi)->DenseRange(1, 9, 4);
+BENCHMARK(BM_std_stoi)->DenseRange(1, 9, 4);
+BENCHMARK(BM_from_chars)->DenseRange(1, 9, 4);
+BENCHMARK(BM_fmt_format);
+BENCHMARK(BM_format_to_n);
+BENCHMARK(BM_to_chars);
+BENCHMARK(BM_do_response)->RangeMultiplier(4)->Range(8, 8192);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,90 @@
+#include "sync_calculator/evaluator.hpp"
+#include "sync_calculator/result_cache.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace fs = std::filesystem;
+
+static const fs::path cache_file =
+    fs::temp_directory_path() / "bench_result_cache.bin";
+static constexpr size_t cache_capacity = 1 << 16;
+
+// `n` distinct expressions that do not take the BatchEvaluator path, each
+// requested 4 times in random order
+static std::vector<std::string> make_workload(size_t n) {
+  std::mt19937 rand(0);
+  std::uniform_int_distribution<int> dist(0, 1 << 10);
+  std::vector<std::string> workload;
+  for (size_t i = 0; i < n; i++) {
+    workload.emplace_back(fmt::format("({}+{})*({}+{})+{}*{}", dist(rand),
+                                      dist(rand), dist(rand), dist(rand),
+                                      dist(rand), dist(rand)));
+  }
+  for (size_t i = 0; i < 3 * n; i++) {
+    workload.emplace_back(workload[i % n]);
+  }
+  std::shuffle(workload.begin(), workload.end(), rand);
+  return workload;
+}
+
+// same as Responser::do_response
+static int cached_evaluate(ResultCache &cache, std::string_view expression) {
+  if (auto value = cache.find(expression)) {
+    return *value;
+  }
+  int value = evaluate(expression);
+  cache.insert(expression, value);
+  return value;
+}
+
+static void run(benchmark::State &state, bool warm) {
+  auto workload = make_workload(state.range(0));
+  if (warm) {
+    fs::remove(cache_file);
+    ResultCache cache(cache_file, cache_capacity);
+    for (const auto &expression : workload) {
+      cached_evaluate(cache, expression);
+    }
+  }
+  for (auto _ : state) {
+    if (!warm) {
+      state.PauseTiming();
+      fs::remove(cache_file);
+      state.ResumeTiming();
+    }
+    // a restart, including loading the cache file
+    ResultCache cache(cache_file, cache_capacity);
+    for (const auto &expression : workload) {
+      benchmark::DoNotOptimize(cached_evaluate(cache, expression));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * workload.size());
+  fs::remove(cache_file);
+}
+
+static void BM_cold_start(benchmark::State &state) { run(state, false); }
+static void BM_warm_start(benchmark::State &state) { run(state, true); }
+
+BENCHMARK(BM_cold_start)
+    ->RangeMultiplier(4)
+    ->Range(256, 16384)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_warm_start)
+    ->RangeMultiplier(4)
+    ->Range(256, 16384)
+    ->Unit(benchmark::kMillisecond);
+
+int main(int argc, char **argv) {
+  // ResultCache logs every load
+  spdlog::set_level(spdlog::level::warn);
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -1,23 +1,66 @@
 grammar Calculator;
 
+@lexer::header {
+#include "utils/exceptions.hpp"
+}
+
+@lexer::members {
+// 0 means unlimited
+size_t max_tokens{};
+size_t token_count{};
+
+std::unique_ptr<antlr4::Token> nextToken() override {
+  if (++token_count > max_tokens && max_tokens != 0) {
+    throw limit_error(limit_error::tokens, "token count exceeds {}",
+                      max_tokens);
+  }
+  return antlr4::Lexer::nextToken();
+}
+}
+
 @parser::header {
 #include <string>
+
+#include "utils/exceptions.hpp"
 }
 
 @parser::members {
 int expression_value{};
+// 0 means unlimited
+size_t max_depth{};
+size_t max_steps{};
+size_t depth{};
+size_t peak_depth{};
+size_t step_count{};
+
+void enter() {
+  if (++depth > max_depth && max_depth != 0) {
+    throw limit_error(limit_error::depth, "nesting depth exceeds {}",
+                      max_depth);
+  }
+  peak_depth = std::max(peak_depth, depth);
+}
+
+void leave() { depth--; }
+
+void step() {
+  if (++step_count > max_steps && max_steps != 0) {
+    throw limit_error(limit_error::steps, "evaluation steps exceed {}",
+                      max_steps);
+  }
+}
 }
 
 // Parser rule names must start with a lowercase letter 
 // and lexer rules must start with a capital letter.
 s: e EOF { expression_value = $e.v; } ;
 e returns [ int v ]
- : a=e '+' b=t { $v = $a.v + $b.v; } 
+ : a=e '+' b=t { step(); $v = $a.v + $b.v; } 
  | t { $v = $t.v; };
 t returns [ int v ]
- : a=t '*' b=f { $v = $a.v * $b.v; }
+ : a=t '*' b=f { step(); $v = $a.v * $b.v; }
  | f { $v = $f.v; };
 f returns [ int v ]
- : '(' e ')' { $v = $e.v; }
- | DIGITS { $v = std::stoi($DIGITS.text); };
-DIGITS: [0-9]+; 
\ No newline at end of file
+ : '(' { enter(); } e ')' { leave(); $v = $e.v; }
+ | DIGITS { step(); $v = std::stoi($DIGITS.text); };
+DIGITS: [0-9]+;
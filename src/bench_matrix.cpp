@@ -0,0 +1,531 @@
+#include "utils/client.hpp"
+#include "utils/common.hpp"
+#include "utils/endpoint.hpp"
+#include "utils/exceptions.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <argparse/argparse.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+namespace ch = std::chrono;
+
+// Run benchmark_calculator against every server binary on loopback for every
+// combination of protocol, transport (TCP, a unix domain socket or shared
+// memory rings), socket options preset, client threads, connections and
+// pipeline depth, write the results as json and csv and compare them to a
+// baseline csv of a previous run.
+
+struct matrix_point {
+  std::string server{};
+  std::string protocol{};
+  // "tcp", "unix" or "shm"
+  std::string transport{};
+  std::string socket_options{};
+  int threads{};
+  int clients{};
+  int pipeline_depth{};
+
+  std::string key() const {
+    return fmt::format("{},{},{},{},{},{},{}", server, protocol, transport,
+                       socket_options, threads, clients, pipeline_depth);
+  }
+};
+
+struct matrix_result {
+  matrix_point point{};
+  // false if the run failed or timed out, the numbers are 0 then
+  bool ok{};
+  int fail_connections{};
+  double throughput{};
+  double p50_us{};
+  double p99_us{};
+  double max_us{};
+  // server cpu time per request, if it could be sampled
+  std::optional<double> server_cpu_us{};
+};
+
+static std::vector<std::string> split(std::string_view s, char separator) {
+  std::vector<std::string> parts;
+  while (true) {
+    size_t end = s.find(separator);
+    parts.emplace_back(s.substr(0, end));
+    if (end == std::string_view::npos) {
+      break;
+    }
+    s.remove_prefix(end + 1);
+  }
+  return parts;
+}
+
+static std::vector<int> parse_int_list(std::string_view s) {
+  std::vector<int> values;
+  for (const auto &part : split(s, ',')) {
+    values.push_back(std::stoi(part));
+  }
+  return values;
+}
+
+// rows of a csv file with a header line, as column name -> value
+static std::vector<std::map<std::string, std::string>>
+read_csv(const fs::path &path) {
+  std::ifstream file(path);
+  if (!file) {
+    THROW("failed to open {}", path.string());
+  }
+  std::vector<std::map<std::string, std::string>> rows;
+  std::string line;
+  std::vector<std::string> columns;
+  while (std::getline(file, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    if (columns.empty()) {
+      columns = split(line, ',');
+      continue;
+    }
+    auto values = split(line, ',');
+    if (values.size() != columns.size()) {
+      THROW("malformed row in {}: {}", path.string(), line);
+    }
+    auto &row = rows.emplace_back();
+    for (size_t i = 0; i < columns.size(); i++) {
+      row[columns[i]] = values[i];
+    }
+  }
+  return rows;
+}
+
+// fork and exec `args`, stdout and stderr go to `log`
+static pid_t spawn(const std::vector<std::string> &args, const fs::path &log) {
+  std::vector<char *> argv;
+  for (const auto &arg : args) {
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+  pid_t pid;
+  CHECK(pid = fork());
+  if (pid == 0) {
+    int fd = ::open(log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd != -1) {
+      dup2(fd, STDOUT_FILENO);
+      dup2(fd, STDERR_FILENO);
+      close(fd);
+    }
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+  return pid;
+}
+
+// exit status of `pid`, or nullopt if it was killed at `deadline`
+static std::optional<int> wait_until(pid_t pid,
+                                     ch::steady_clock::time_point deadline) {
+  while (true) {
+    int status;
+    pid_t waited;
+    CHECK(waited = waitpid(pid, &status, WNOHANG));
+    if (waited == pid) {
+      return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+    if (ch::steady_clock::now() >= deadline) {
+      kill(pid, SIGKILL);
+      waitpid(pid, &status, 0);
+      return std::nullopt;
+    }
+    std::this_thread::sleep_for(ch::milliseconds(100));
+  }
+}
+
+static bool wait_listening(const Endpoint &endpoint,
+                           ch::milliseconds timeout) {
+  auto deadline = ch::steady_clock::now() + timeout;
+  while (ch::steady_clock::now() < deadline) {
+    try {
+      Client client{endpoint};
+      client.connect();
+      close(client.handle());
+      return true;
+    } catch (const std::exception &) {
+      std::this_thread::sleep_for(ch::milliseconds(50));
+    }
+  }
+  return false;
+}
+
+struct matrix_options {
+  fs::path bin_dir{};
+  fs::path work_dir{};
+  std::vector<std::string> servers{};
+  std::vector<std::string> protocols{};
+  std::vector<std::string> transports{};
+  std::vector<std::string> socket_options{};
+  // (client threads, connections), combinations with more threads than
+  // connections are left out
+  std::vector<std::pair<int, int>> thread_clients{};
+  std::vector<int> pipeline_depths{};
+  int time{};
+  int grace{};
+  uint16_t port{};
+};
+
+// the address and transport arguments of a server and benchmark_calculator
+static std::vector<std::string> transport_args(const matrix_point &point,
+                                               const Endpoint &endpoint) {
+  if (!endpoint.is_unix()) {
+    return {"--server-port", std::to_string(ntohs(endpoint.inet().sin_port))};
+  }
+  std::vector<std::string> args{"--unix-socket", endpoint.path()};
+  if (point.transport == "shm") {
+    args.insert(args.end(), {"--transport", "shm"});
+  }
+  return args;
+}
+
+static matrix_result run_point(const matrix_options &options,
+                               const matrix_point &point,
+                               const Endpoint &endpoint, pid_t server_pid) {
+  matrix_result result{point};
+  fs::path report = options.work_dir / "report.csv";
+  fs::remove(report);
+  std::vector<std::string> args{
+      (options.bin_dir / "benchmark_calculator").string(),
+      "--thread",
+      std::to_string(point.threads),
+      "--client",
+      std::to_string(point.clients),
+      "--time",
+      std::to_string(options.time),
+      "--pipeline-depth",
+      std::to_string(point.pipeline_depth),
+      "--protocol",
+      point.protocol,
+      "--socket-options",
+      point.socket_options,
+      "--server-pid",
+      std::to_string(server_pid),
+      "--report",
+      report.string()};
+  auto address = transport_args(point, endpoint);
+  args.insert(args.end(), address.begin(), address.end());
+  pid_t pid = spawn(args, options.work_dir / "benchmark_calculator.log");
+  auto status = wait_until(pid, ch::steady_clock::now() +
+                                    ch::seconds(options.time + options.grace));
+  if (!status) {
+    ERROR("{}: timed out", point.key());
+    return result;
+  }
+  if (*status != 0 || !fs::exists(report)) {
+    ERROR("{}: benchmark_calculator exited with {}", point.key(), *status);
+    return result;
+  }
+  auto rows = read_csv(report);
+  if (rows.empty()) {
+    ERROR("{}: empty report", point.key());
+    return result;
+  }
+  auto &row = rows.back();
+  result.ok = true;
+  result.fail_connections = std::stoi(row.at("fail_connections"));
+  result.throughput = std::stod(row.at("throughput"));
+  result.p50_us = std::stod(row.at("p50_us"));
+  result.p99_us = std::stod(row.at("p99_us"));
+  result.max_us = std::stod(row.at("max_us"));
+  if (!row["server_cpu_us_per_request"].empty()) {
+    result.server_cpu_us = std::stod(row["server_cpu_us_per_request"]);
+  }
+  INFO("{}: {:.0f} requests/s, p50: {} us, p99: {} us, server cpu: {} "
+       "us/request",
+       point.key(), result.throughput, result.p50_us, result.p99_us,
+       result.server_cpu_us ? fmt::format("{:.2f}", *result.server_cpu_us)
+                            : std::string("unknown"));
+  return result;
+}
+
+// start the server of `point` (threads, clients and pipeline depth aside) at
+// `endpoint` and run every client combination against it
+static void run_server(const matrix_options &options,
+                       const matrix_point &point, const Endpoint &endpoint,
+                       std::vector<matrix_result> &results) {
+  fs::path binary = options.bin_dir / point.server;
+  if (!fs::exists(binary)) {
+    THROW("server binary {} does not exist", binary.string());
+  }
+  std::vector<std::string> args{binary.string(),
+                                "--backlog-size",
+                                "4096",
+                                "--protocol",
+                                point.protocol,
+                                "--socket-options",
+                                point.socket_options};
+  auto address = transport_args(point, endpoint);
+  args.insert(args.end(), address.begin(), address.end());
+  pid_t pid = spawn(args, options.work_dir / (point.server + ".log"));
+  if (!wait_listening(endpoint, ch::seconds(5))) {
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    THROW("{} does not listen on {}", point.server, endpoint);
+  }
+  // the probe connection of wait_listening is served first by the blocking
+  // server, let it go away before the benchmark connects
+  std::this_thread::sleep_for(ch::milliseconds(100));
+  for (auto [threads, clients] : options.thread_clients) {
+    for (int depth : options.pipeline_depths) {
+      matrix_point client_point = point;
+      client_point.threads = threads;
+      client_point.clients = clients;
+      client_point.pipeline_depth = depth;
+      results.push_back(run_point(options, client_point, endpoint, pid));
+    }
+  }
+  kill(pid, SIGTERM);
+  if (!wait_until(pid, ch::steady_clock::now() + ch::seconds(5))) {
+    ERROR("{} did not terminate, killed", point.server);
+  }
+}
+
+static std::vector<matrix_result> run_matrix(const matrix_options &options) {
+  std::vector<matrix_result> results;
+  uint16_t port = options.port;
+  for (const auto &server : options.servers) {
+    for (const auto &protocol : options.protocols) {
+      for (const auto &transport : options.transports) {
+        for (const auto &preset : options.socket_options) {
+          Endpoint endpoint;
+          if (transport == "tcp") {
+            // a fresh port per server process, the previous one may linger
+            // in TIME_WAIT
+            endpoint = Endpoint{++port};
+          } else if (transport == "unix" || transport == "shm") {
+            endpoint = Endpoint::unix_socket(
+                (options.work_dir / (server + ".sock")).string());
+          } else {
+            THROW("unknown transport {}, expect tcp, unix or shm", transport);
+          }
+          run_server(options, {server, protocol, transport, preset}, endpoint,
+                     results);
+        }
+      }
+    }
+  }
+  return results;
+}
+
+static void write_csv(const fs::path &path,
+                      const std::vector<matrix_result> &results) {
+  std::ofstream file(path);
+  file << "server,protocol,transport,socket_options,threads,clients,"
+          "pipeline_depth,ok,fail_connections,throughput,p50_us,p99_us,max_us,"
+          "server_cpu_us_per_request\n";
+  for (const auto &r : results) {
+    file << fmt::format(
+        "{},{},{},{:.1f},{:.1f},{:.1f},{:.1f},{}\n", r.point.key(),
+        r.ok ? 1 : 0, r.fail_connections, r.throughput, r.p50_us, r.p99_us,
+        r.max_us,
+        r.server_cpu_us ? fmt::format("{:.3f}", *r.server_cpu_us) : "");
+  }
+}
+
+static void write_json(const fs::path &path,
+                       const std::vector<matrix_result> &results) {
+  std::ofstream file(path);
+  file << "[\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto &r = results[i];
+    file << fmt::format(
+        "  {{\"server\": \"{}\", \"protocol\": \"{}\", \"transport\": \"{}\", "
+        "\"socket_options\": \"{}\", \"threads\": {}, \"clients\": {}, "
+        "\"pipeline_depth\": {}, \"ok\": {}, "
+        "\"fail_connections\": {}, \"throughput\": {:.1f}, \"p50_us\": "
+        "{:.1f}, \"p99_us\": {:.1f}, \"max_us\": {:.1f}, "
+        "\"server_cpu_us_per_request\": {}}}{}\n",
+        r.point.server, r.point.protocol, r.point.transport,
+        r.point.socket_options, r.point.threads, r.point.clients,
+        r.point.pipeline_depth, r.ok, r.fail_connections, r.throughput,
+        r.p50_us, r.p99_us, r.max_us,
+        r.server_cpu_us ? fmt::format("{:.3f}", *r.server_cpu_us) : "null",
+        i + 1 < results.size() ? "," : "");
+  }
+  file << "]\n";
+}
+
+// a point regresses if its throughput dropped, or its p99 latency or the
+// server cpu time per request rose by more than `threshold` (relative)
+// compared to the baseline, return the number of regressions
+static int compare_baseline(const fs::path &baseline,
+                            const std::vector<matrix_result> &results,
+                            double threshold) {
+  std::map<std::string, std::map<std::string, std::string>> baseline_rows;
+  for (auto &row : read_csv(baseline)) {
+    // baselines from before the transport and socket options dimensions
+    // used tcp with the defaults
+    if (row["transport"].empty()) {
+      row["transport"] = "tcp";
+    }
+    if (row["socket_options"].empty()) {
+      row["socket_options"] = "default";
+    }
+    std::string key =
+        fmt::format("{},{},{},{},{},{},{}", row["server"], row["protocol"],
+                    row["transport"], row["socket_options"], row["threads"],
+                    row["clients"], row["pipeline_depth"]);
+    baseline_rows[key] = std::move(row);
+  }
+  int n_regressions = 0;
+  for (const auto &r : results) {
+    auto iter = baseline_rows.find(r.point.key());
+    if (iter == baseline_rows.end() || iter->second["ok"] != "1") {
+      INFO("{}: no baseline", r.point.key());
+      continue;
+    }
+    double base_throughput = std::stod(iter->second["throughput"]);
+    double base_p99 = std::stod(iter->second["p99_us"]);
+    std::string verdict = "ok";
+    if (!r.ok) {
+      verdict = "REGRESSION (failed)";
+    } else if (r.throughput < base_throughput * (1 - threshold)) {
+      verdict = "REGRESSION (throughput)";
+    } else if (r.p99_us > base_p99 * (1 + threshold)) {
+      verdict = "REGRESSION (p99)";
+    } else if (std::string base_cpu = iter->second["server_cpu_us_per_request"];
+               r.server_cpu_us && !base_cpu.empty() &&
+               *r.server_cpu_us > std::stod(base_cpu) * (1 + threshold)) {
+      verdict = fmt::format("REGRESSION (server cpu {} -> {:.3f} us/request)",
+                            base_cpu, *r.server_cpu_us);
+    }
+    if (verdict != "ok") {
+      n_regressions++;
+    }
+    INFO("{}: throughput {:.0f} -> {:.0f} requests/s, p99 {:.1f} -> {:.1f} "
+         "us, {}",
+         r.point.key(), base_throughput, r.throughput, base_p99, r.p99_us,
+         verdict);
+  }
+  return n_regressions;
+}
+
+int main(int argc, char **argv) {
+  argparse::ArgumentParser parser(fs::path(argv[0]).filename());
+  parser.add_argument("--bin-dir")
+      .default_value<std::string>(
+          fs::absolute(fs::path(argv[0])).parent_path().string())
+      .help("directory of the server binaries and benchmark_calculator");
+  parser.add_argument("--servers")
+      .default_value<std::string>("st_sync_server,st_select_server")
+      .help("comma separated server binaries");
+  parser.add_argument("--protocols")
+      .default_value<std::string>("text")
+      .help("comma separated wire protocols");
+  parser.add_argument("--transports")
+      .default_value<std::string>("tcp")
+      .help("comma separated transports: tcp (loopback), unix (a unix "
+            "domain socket in OUTPUT.d/) or shm (shared memory rings, "
+            "st_select_server only, needs pipeline depths > 0)");
+  parser.add_argument("--socket-options")
+      .default_value<std::string>("default")
+      .help("comma separated socket options presets: default, low-latency or "
+            "throughput");
+  parser.add_argument("--threads")
+      .default_value<std::string>("1,4")
+      .help("comma separated client thread counts, combinations with fewer "
+            "clients than threads are skipped");
+  parser.add_argument("--clients")
+      .default_value<std::string>("1,16,256")
+      .help("comma separated connection counts");
+  parser.add_argument("--pipeline-depths")
+      .default_value<std::string>("1,16")
+      .help("comma separated pipeline depths");
+  parser.add_argument("--time", "-t")
+      .default_value<int>(5)
+      .scan<'i', int>()
+      .metavar("SECONDS");
+  parser.add_argument("--grace")
+      .default_value<int>(30)
+      .scan<'i', int>()
+      .metavar("SECONDS")
+      .help("a run is killed this long after --time");
+  parser.add_argument("--port")
+      .default_value<uint16_t>(17814)
+      .scan<'i', uint16_t>()
+      .help("servers listen on the ports following this one");
+  parser.add_argument("--output", "-o")
+      .default_value<std::string>("bench_matrix")
+      .help("results are written to OUTPUT.json and OUTPUT.csv, logs to "
+            "OUTPUT.d/");
+  parser.add_argument("--baseline")
+      .metavar("CSV")
+      .help("csv of a previous run to compare with");
+  parser.add_argument("--threshold")
+      .default_value<double>(0.05)
+      .scan<'g', double>()
+      .metavar("RATIO")
+      .help("relative change counted as regression");
+
+  signal(SIGPIPE, SIG_IGN);
+
+  try {
+    parser.parse_args(argc, argv);
+  } catch (const std::runtime_error &err) {
+    fmt::print("{}\n\n", err.what());
+    fmt::print("{}", parser);
+    exit(-1);
+  }
+
+  try {
+    matrix_options options;
+    options.bin_dir = parser.get<std::string>("--bin-dir");
+    options.servers = split(parser.get<std::string>("--servers"), ',');
+    options.protocols = split(parser.get<std::string>("--protocols"), ',');
+    options.transports = split(parser.get<std::string>("--transports"), ',');
+    options.socket_options =
+        split(parser.get<std::string>("--socket-options"), ',');
+    auto clients = parse_int_list(parser.get<std::string>("--clients"));
+    for (int threads : parse_int_list(parser.get<std::string>("--threads"))) {
+      for (int n_clients : clients) {
+        // benchmark_calculator needs a connection per thread
+        if (threads > n_clients) {
+          INFO("skip {} threads with {} clients", threads, n_clients);
+          continue;
+        }
+        options.thread_clients.emplace_back(threads, n_clients);
+      }
+    }
+    options.pipeline_depths =
+        parse_int_list(parser.get<std::string>("--pipeline-depths"));
+    options.time = parser.get<int>("--time");
+    options.grace = parser.get<int>("--grace");
+    options.port = parser.get<uint16_t>("--port");
+    std::string output = parser.get<std::string>("--output");
+    options.work_dir = output + ".d";
+    fs::create_directories(options.work_dir);
+
+    auto results = run_matrix(options);
+    write_csv(output + ".csv", results);
+    write_json(output + ".json", results);
+    INFO("results written to {0}.csv and {0}.json", output);
+
+    if (auto baseline = parser.present("--baseline")) {
+      int n_regressions = compare_baseline(*baseline, results,
+                                           parser.get<double>("--threshold"));
+      if (n_regressions > 0) {
+        ERROR("{} regressions", n_regressions);
+        return 1;
+      }
+    }
+  } catch (const std::exception &e) {
+    ERROR(e.what());
+    exit(-1);
+  }
+  return 0;
+}
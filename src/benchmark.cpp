@@ -1,13 +1,23 @@
 #include "sync_calculator/requester.hpp"
+#include "sync_calculator/workload.hpp"
 #include "utils/client.hpp"
 #include "utils/common.hpp"
+#include "utils/endpoint.hpp"
+#include "utils/epoll.hpp"
 #include "utils/exceptions.hpp"
+#include "utils/histogram.hpp"
+#include "utils/proc_stats.hpp"
+#include "utils/socket_options.hpp"
 
 #include <condition_variable>
 #include <exception>
 #include <mutex>
+#include <poll.h>
 #include <signal.h>
-#include <sys/select.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include <argparse/argparse.hpp>
@@ -16,12 +26,80 @@
 #include <atomic>
 #include <chrono>
 #include <filesystem>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
 #include <thread>
-#include <unordered_set>
 
 namespace fs = std::filesystem;
 namespace ch = std::chrono;
 
+enum class arrival_type { poisson, uniform };
+
+class ControlChannel;
+
+struct benchmark_options {
+  // --server-ip and --server-port, or --unix-socket
+  Endpoint server_endpoint{};
+  // "socket", or "shm": a ShmChannel per connection, set up over the unix
+  // socket
+  std::string transport{};
+  uint16_t threads{};
+  int clients{};
+  uint16_t time{};
+  // aggregate requests per second of an open loop run, 0 means closed loop
+  double rate{};
+  arrival_type arrival{};
+  // requests in flight per connection, 1 is strict request/response and 0
+  // lets the queue grow unbounded
+  int pipeline_depth{};
+  // expressions to send, shared by all threads
+  const Workload *workload{};
+  // every run appends a csv row to this file if given
+  std::string report_file{};
+  // of every connection
+  SocketOptions socket_options{};
+  // non-blocking connects in flight per thread while establishing the
+  // connections, started at this aggregate rate (per second, 0 means as fast
+  // as the limit allows)
+  int connects_in_flight{};
+  double connect_rate{};
+  // churn mode: a connection per request, with SO_LINGER set to this
+  // timeout (seconds) if not negative
+  bool churn{};
+  int linger{-1};
+  // resource usage of this process is sampled during the run, 0 disables it
+  pid_t server_pid{};
+  // the threads of all agents of a coordinated run form one sequence of
+  // workload streams, this process runs [stream_offset, stream_offset +
+  // threads) of stream_count (0 means threads)
+  size_t stream_offset{};
+  size_t stream_count{};
+  // agent of a coordinated run: connections are established before the
+  // coordinator is told so, requests start on its signal
+  ControlChannel *control{};
+};
+
+struct benchmark_report {
+  int fail_connections{};
+  int requests{};
+  double elapsed{};
+  Histogram latency{};
+  // from the start of connect() to the established connection
+  Histogram connect_latency{};
+  // of the load generator itself, and of the server if its pid is known
+  process_stats client_usage{};
+  std::optional<process_stats> server_usage{};
+  std::optional<PerfCounters::counts> server_perf{};
+
+  double throughput() const { return requests / elapsed; }
+  // `total` of a run divided by the number of requests
+  double per_request(double total) const {
+    return requests > 0 ? total / requests : 0;
+  }
+};
+
 std::atomic<int> total_fail_connections = 0;
 std::atomic<int> total_requests = 0;
 
@@ -32,38 +110,265 @@ std::atomic<bool> start = false;
 std::atomic<bool> finish = false;
 std::atomic<int> connected_count = 0;
 
-void workload(std::string_view server_ip, uint16_t server_port, int n_clients) {
-  INFO("[{}] n_clients: {}", std::this_thread::get_id(), n_clients);
+// per thread latency histograms are merged into these ones, the connect
+// latency once connections are established, the other at the end
+std::mutex latency_mutex;
+Histogram total_latency;
+Histogram total_connect_latency;
 
-  std::unordered_map<Client, Requester> requesters;
-  requesters.reserve(n_clients);
+// intended send times of an open loop workload, requests are issued at these
+// times no matter whether the server keeps up
+class ArrivalSchedule {
+public:
+  using clock = ch::steady_clock;
 
-  int n_fail_connections = 0;
-  int n_total_requests = 0;
+  ArrivalSchedule(double rate, arrival_type type, uint32_t seed)
+      : rate(rate), interval(rate), type(type), rand(seed) {
+    next_time = clock::now();
+    advance();
+  }
 
-  fd_set original_read_fds, original_write_fds, read_fds, write_fds;
-  int max_fd_number = -1;
+  clock::time_point next() const { return next_time; }
+  void advance() {
+    double seconds =
+        type == arrival_type::poisson ? interval(rand) : 1.0 / rate;
+    next_time +=
+        ch::duration_cast<clock::duration>(ch::duration<double>(seconds));
+  }
 
-  FD_ZERO(&original_read_fds);
-  FD_ZERO(&original_write_fds);
+private:
+  double rate;
+  // inter-arrival time of a poisson process is exponentially distributed
+  std::exponential_distribution<double> interval;
+  arrival_type type;
+  std::mt19937 rand;
+  clock::time_point next_time{};
+};
 
-  for (int i = 0; i < n_clients; i++) {
-    try {
-      auto client = Client{server_ip, server_port};
-      client.connect();
-      // 这个可以检测出来？？
-      set_fd_status_flag(client.handle(), O_NONBLOCK);
-      FD_SET(client.handle(), &original_read_fds);
-      FD_SET(client.handle(), &original_write_fds);
-      requesters.emplace(client, Requester{client.handle()});
-    } catch (std::exception &err) {
-      ERROR(err.what());
-      n_fail_connections++;
+// a connection of a worker thread, the epoll key of its stream is its index
+// in the session table
+template <typename Codec, typename Stream> struct LoadSession {
+  Client client;
+  BasicRequester<Codec, FixedBuffer<1024>, Stream> requester;
+  bool open = true;
+  // whether EPOLLOUT is part of the current interest set
+  bool want_write = false;
+};
+
+// epoll key of the timerfd which fires at the next open loop arrival
+constexpr uint64_t timer_key = UINT64_MAX;
+
+void arm_timer(int timer_fd, ch::steady_clock::time_point when) {
+  // steady_clock is CLOCK_MONOTONIC, an expiry in the past fires at once
+  auto ns = ch::duration_cast<ch::nanoseconds>(when.time_since_epoch()).count();
+  itimerspec spec{};
+  spec.it_value.tv_sec = ns / 1000000000;
+  spec.it_value.tv_nsec = ns % 1000000000;
+  if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+    spec.it_value.tv_nsec = 1;
+  }
+  CHECK(timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr));
+}
+
+// a connect() of establish_connections() waiting for writability, or for the
+// shm channel (readability) until `deadline` once connected
+struct pending_connect {
+  Client client;
+  ch::steady_clock::time_point begin;
+  bool handshake{};
+  ch::steady_clock::time_point deadline{};
+};
+
+// Connect `n_clients` sessions to the server with non-blocking connects, at
+// most options.connects_in_flight at a time and started no faster than this
+// thread's share of options.connect_rate. The shm handshake is driven by the
+// same loop, it counts as part of the connect. Returns the number of failed
+// connections.
+template <typename Codec, typename Stream>
+int establish_connections(const benchmark_options &options, int n_clients,
+                          std::vector<LoadSession<Codec, Stream>> &sessions,
+                          Histogram &connect_latency, Histogram *latency) {
+  using clock = ch::steady_clock;
+  const double rate = options.connect_rate / options.threads;
+  // a unix connect never is in progress, it completes at once or fails with
+  // EAGAIN while the accept queue is full
+  const bool is_unix = options.server_endpoint.is_unix();
+  std::vector<std::optional<pending_connect>> pending(
+      options.connects_in_flight);
+  std::vector<uint64_t> free_slots;
+  for (size_t i = pending.size(); i > 0; i--) {
+    free_slots.push_back(i - 1);
+  }
+  // as ShmChannel::connect()
+  constexpr auto handshake_timeout = ch::seconds(5);
+  constexpr bool is_shm = std::is_same_v<Stream, ShmChannel>;
+  Epoll epoll;
+  int n_started = 0;
+  int n_fail = 0;
+
+  // take a free slot
+  auto wait_for = [&](pending_connect connect, uint32_t events) {
+    uint64_t slot = free_slots.back();
+    epoll.add(connect.client.handle(), events, slot);
+    free_slots.pop_back();
+    pending[slot] = std::move(connect);
+  };
+  auto established = [&](Client &client, clock::time_point begin,
+                         Stream stream) {
+    connect_latency.record(
+        ch::duration_cast<ch::nanoseconds>(clock::now() - begin).count());
+    sessions.push_back({client, {std::move(stream), latency}});
+  };
+  // called with a free slot
+  auto connected = [&](Client &client, clock::time_point begin) {
+    if constexpr (is_shm) {
+      wait_for({client, begin, true, clock::now() + handshake_timeout},
+               EPOLLIN);
+    } else {
+      established(client, begin, client.handle());
+    }
+  };
+  auto fail = [&](int fd, const std::exception &err) {
+    ERROR(err.what());
+    if (fd != -1) {
+      close(fd);
+    }
+    n_fail++;
+  };
+
+  clock::time_point ramp_begin = clock::now();
+  while (n_started < n_clients || free_slots.size() < pending.size()) {
+    int timeout_ms = -1;
+    while (n_started < n_clients && !free_slots.empty()) {
+      clock::time_point now = clock::now();
+      if (rate > 0) {
+        auto due = ramp_begin + ch::duration_cast<clock::duration>(
+                                    ch::duration<double>(n_started / rate));
+        if (due > now) {
+          timeout_ms = static_cast<int>(
+              ch::ceil<ch::milliseconds>(due - now).count());
+          break;
+        }
+      }
+      n_started++;
+      int fd = -1;
+      try {
+        Client client{options.server_endpoint, options.socket_options};
+        fd = client.handle();
+        set_fd_status_flag(fd, O_NONBLOCK);
+        try {
+          client.connect();
+          connected(client, now);
+          continue;
+        } catch (const temporarily_unavailable_error &) {
+        }
+        if (is_unix) {
+          // retry once the server accepted some
+          close(fd);
+          n_started--;
+          timeout_ms = 1;
+          break;
+        }
+        wait_for({client, now}, EPOLLOUT);
+      } catch (const std::exception &err) {
+        fail(fd, err);
+      }
+    }
+    if (free_slots.size() == pending.size() && timeout_ms == -1) {
+      continue;
+    }
+    if (is_shm && free_slots.size() < pending.size()) {
+      // wake up for the handshake deadlines
+      timeout_ms = timeout_ms == -1 ? 100 : std::min(timeout_ms, 100);
+    }
+    size_t n_ready = epoll.wait(timeout_ms);
+    for (size_t k = 0; k < n_ready; k++) {
+      const epoll_event &event = epoll.event(k);
+      uint64_t slot = event.data.u64;
+      pending_connect connect = std::move(*pending[slot]);
+      pending[slot].reset();
+      free_slots.push_back(slot);
+      int fd = connect.client.handle();
+      try {
+        epoll.remove(fd);
+        if constexpr (is_shm) {
+          if (connect.handshake) {
+            // the server passed the channel, or closed the socket
+            if (auto channel = ShmChannel::try_connect(fd)) {
+              established(connect.client, connect.begin, std::move(*channel));
+            } else {
+              wait_for(std::move(connect), EPOLLIN);
+            }
+            continue;
+          }
+        }
+        // the result of connect() once the socket is writable
+        int error = 0;
+        socklen_t size = sizeof(error);
+        CHECK(getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size));
+        if (error == 0 && (event.events & EPOLLHUP)) {
+          error = ENOTCONN;
+        }
+        if (error != 0) {
+          THROW("connect to {}: {}", options.server_endpoint,
+                get_errno_string(error));
+        }
+        connected(connect.client, connect.begin);
+      } catch (const std::exception &err) {
+        fail(fd, err);
+      }
+    }
+    if constexpr (is_shm) {
+      clock::time_point now = clock::now();
+      for (uint64_t slot = 0; slot < pending.size(); slot++) {
+        if (!pending[slot] || !pending[slot]->handshake ||
+            now < pending[slot]->deadline) {
+          continue;
+        }
+        int fd = pending[slot]->client.handle();
+        epoll.remove(fd);
+        pending[slot].reset();
+        free_slots.push_back(slot);
+        fail(fd, program_error("no shared memory channel received, is the "
+                               "server started with --transport shm?"));
+      }
     }
   }
+  INFO("[{}] {} connections in {:.1f} ms, connect latency: {}",
+       std::this_thread::get_id(), sessions.size(),
+       ch::duration<double, std::milli>(clock::now() - ramp_begin).count(),
+       connect_latency.latency_summary());
+  return n_fail;
+}
+
+template <typename Codec, typename Stream>
+void workload(const benchmark_options &options, int n_clients,
+              uint32_t seed) {
+  using Session = LoadSession<Codec, Stream>;
+  INFO("[{}] n_clients: {}", std::this_thread::get_id(), n_clients);
+
+  WorkloadStream stream(*options.workload, seed, seed,
+                        options.stream_count ? options.stream_count
+                                             : options.threads);
+
+  std::vector<Session> sessions;
+  sessions.reserve(n_clients);
+  Epoll epoll;
+
+  int n_total_requests = 0;
+  Histogram latency;
+  Histogram connect_latency;
+
+  int n_fail_connections = establish_connections<Codec, Stream>(
+      options, n_clients, sessions, connect_latency, &latency);
+  size_t n_open = sessions.size();
 
   INFO("[{}] fail connections: {}", std::this_thread::get_id(),
        n_fail_connections);
+  {
+    std::lock_guard lock{latency_mutex};
+    total_connect_latency.merge(connect_latency);
+  }
 
   connected_count++;
   wait_connection.notify_all();
@@ -74,111 +379,213 @@ void workload(std::string_view server_ip, uint16_t server_port, int n_clients) {
 
   INFO("[{}] start requesting", std::this_thread::get_id());
 
+  // open loop: each thread issues its share of the aggregate rate, spread
+  // over its sessions round robin
+  std::optional<ArrivalSchedule> schedule;
+  int timer_fd = -1;
+  if (options.rate > 0) {
+    schedule.emplace(options.rate / options.threads, options.arrival, seed);
+    CHECK(timer_fd = timerfd_create(CLOCK_MONOTONIC,
+                                    TFD_NONBLOCK | TFD_CLOEXEC));
+    epoll.add(timer_fd, EPOLLIN, timer_key);
+    arm_timer(timer_fd, schedule->next());
+  }
+  size_t next_session = 0;
+  // at most `depth` requests in flight per session, 0 means unbounded
+  const int depth = options.pipeline_depth;
+  // free window slots of all open sessions, open loop arrivals which find
+  // none stay in the schedule and keep their intended time
+  long n_free_slots = static_cast<long>(sessions.size()) * depth;
+  bool backlogged = false;
+  // closed loop without a window: a socket is almost always writable, every
+  // writable event issues a request. otherwise only wait for writability
+  // while requests are stuck in user space
+  bool request_on_writable = !schedule && depth == 0;
+
+  auto close_session = [&](Session &sess) {
+    epoll.remove(sess.requester.handle());
+    shutdown(sess.client.handle(), SHUT_RDWR);
+    close(sess.client.handle());
+    sess.open = false;
+    n_open--;
+    if (depth > 0) {
+      n_free_slots -= depth - sess.requester.n_requests();
+    }
+  };
+  auto update_interest = [&](size_t i) {
+    Session &sess = sessions[i];
+    bool want_write = request_on_writable || sess.requester.has_unsent();
+    if (want_write != sess.want_write) {
+      sess.want_write = want_write;
+      epoll.modify(sess.requester.handle(),
+                   EPOLLIN | (want_write ? EPOLLOUT : 0), i);
+    }
+  };
+  auto read_responses = [&](Session &sess) {
+    int in_flight = sess.requester.n_requests();
+    try {
+      sess.requester.do_read();
+    } catch (...) {
+      n_free_slots += in_flight - sess.requester.n_requests();
+      throw;
+    }
+    n_free_slots += in_flight - sess.requester.n_requests();
+  };
+  // closed loop with a window: a response is answered by the next request
+  auto fill_window = [&](Session &sess) {
+    while (sess.requester.n_requests() < depth) {
+      sess.requester.do_request(stream.next());
+      n_total_requests++;
+      n_free_slots--;
+    }
+    sess.requester.do_write();
+  };
+  auto issue_due = [&]() {
+    ch::steady_clock::time_point now = ch::steady_clock::now();
+    backlogged = false;
+    while (schedule->next() <= now && n_open > 0) {
+      if (depth > 0 && n_free_slots == 0) {
+        // the timer stays disarmed, the next response resumes issuing
+        backlogged = true;
+        return;
+      }
+      while (!sessions[next_session].open ||
+             (depth > 0 && sessions[next_session].requester.n_requests() >=
+                               depth)) {
+        next_session = (next_session + 1) % sessions.size();
+      }
+      size_t i = next_session;
+      next_session = (next_session + 1) % sessions.size();
+      Session &sess = sessions[i];
+      sess.requester.do_request(stream.next(), schedule->next());
+      n_total_requests++;
+      n_free_slots--;
+      schedule->advance();
+      try {
+        sess.requester.do_write();
+        update_interest(i);
+      } catch (const std::exception &err) {
+        ERROR("error: {}", err.what());
+        close_session(sess);
+      }
+    }
+    arm_timer(timer_fd, schedule->next());
+  };
+
+  for (size_t i = 0; i < sessions.size(); i++) {
+    sessions[i].want_write = request_on_writable;
+    epoll.add(sessions[i].requester.handle(),
+              EPOLLIN | (sessions[i].want_write ? EPOLLOUT : 0), i);
+  }
+  if (!schedule && depth > 0) {
+    for (size_t i = 0; i < sessions.size(); i++) {
+      try {
+        fill_window(sessions[i]);
+        update_interest(i);
+      } catch (const std::exception &err) {
+        ERROR("error: {}", err.what());
+        close_session(sessions[i]);
+      }
+    }
+  }
+
   try {
-    while (!finish && !requesters.empty()) {
-      max_fd_number =
-          std::max_element(requesters.begin(), requesters.end(),
-                           [](const std::pair<Client, Requester> &a,
-                              const std::pair<Client, Requester> &&b) -> bool {
-                             return a.first.handle() < b.first.handle();
-                           })
-              ->first.handle();
-      memcpy(&read_fds, &original_read_fds, sizeof(original_read_fds));
-      memcpy(&write_fds, &original_write_fds, sizeof(original_write_fds));
-      int n_ready_fds;
-
-      /*
-        EBADF  An invalid file descriptor was given in one of the sets.
-        (Perhaps a file descriptor that was already closed, or one
-        on which an error has occurred.)  However, see BUGS.
-      */
-
-      CHECK(n_ready_fds = select(max_fd_number + 1, &read_fds, &write_fds,
-                                 nullptr, nullptr));
-      for (auto sess_iter = requesters.begin();
-           !finish && sess_iter != requesters.end();) {
-        auto &[sess, resq] = *sess_iter;
+    // the timeout only bounds how late `finish` is noticed
+    while (!finish && n_open > 0) {
+      size_t n_ready = epoll.wait(100);
+      for (size_t k = 0; k < n_ready && !finish; k++) {
+        const epoll_event &event = epoll.event(k);
+        if (event.data.u64 == timer_key) {
+          uint64_t n_expirations;
+          // EAGAIN when the expiry was consumed already, nothing to do then
+          if (read(timer_fd, &n_expirations, sizeof(n_expirations)) == -1 &&
+              errno != EAGAIN) {
+            THROW("{}", get_errno_string(errno));
+          }
+          issue_due();
+          continue;
+        }
+        Session &sess = sessions[event.data.u64];
+        if (!sess.open) {
+          continue;
+        }
         try {
-          if (FD_ISSET(sess.handle(), &write_fds)) {
-            resq.do_request();
-            resq.do_write();
-            n_total_requests++;
+          if (event.events & EPOLLOUT) {
+            if (request_on_writable) {
+              sess.requester.do_request(stream.next());
+              n_total_requests++;
+            }
+            sess.requester.do_write();
           }
-          if (FD_ISSET(sess.handle(), &read_fds)) {
-            resq.do_read();
+          if (event.events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            read_responses(sess);
+            if (!schedule && depth > 0) {
+              fill_window(sess);
+            }
           }
-          sess_iter++;
-          std::this_thread::sleep_for(ch::milliseconds(1));
+          update_interest(event.data.u64);
         } catch (const std::exception &err) {
           ERROR("error: {}", err.what());
-          close(sess.handle());
-          FD_CLR(sess.handle(), &original_read_fds);
-          FD_CLR(sess.handle(), &original_write_fds);
-          sess_iter = requesters.erase(sess_iter);
+          close_session(sess);
         }
       }
+      if (backlogged && !finish) {
+        issue_due();
+      }
     }
   } catch (const std::exception &err) {
     ERROR(err.what());
     return;
   }
+  if (timer_fd != -1) {
+    epoll.remove(timer_fd);
+    close(timer_fd);
+  }
+  request_on_writable = false;
 
   INFO("[{}] total requests: {}", std::this_thread::get_id(), n_total_requests);
   INFO("[{}] read requests", std::this_thread::get_id());
 
-  // 遍历一边，如果以及有完成的直接删除即可
-  for (auto sess_iter = requesters.begin(); sess_iter != requesters.end();) {
-    auto &[sess, resq] = *sess_iter;
-    if (!resq.has_requests()) {
-      shutdown(sess.handle(), SHUT_RDWR);
-      close(sess.handle());
-      FD_CLR(sess.handle(), &original_read_fds);
-      FD_CLR(sess.handle(), &original_write_fds);
-      sess_iter = requesters.erase(sess_iter);
+  // 遍历一边，如果以及有完成的直接删除即可, the rest only waits for
+  // responses and for requests still sitting in user space
+  for (size_t i = 0; i < sessions.size(); i++) {
+    Session &sess = sessions[i];
+    if (!sess.open) {
+      continue;
+    }
+    if (!sess.requester.has_requests()) {
+      close_session(sess);
     } else {
-      sess_iter++;
+      update_interest(i);
     }
   }
 
   INFO("[{}] finish up", std::this_thread::get_id());
 
   try {
-    while (!requesters.empty()) {
-      max_fd_number =
-          std::max_element(requesters.begin(), requesters.end(),
-                           [](const std::pair<Client, Requester> &a,
-                              const std::pair<Client, Requester> &&b) -> bool {
-                             return a.first.handle() < b.first.handle();
-                           })
-              ->first.handle();
-      memcpy(&read_fds, &original_read_fds, sizeof(original_read_fds));
-      int n_ready_fds;
-      CHECK(n_ready_fds = select(max_fd_number + 1, &read_fds, nullptr, nullptr,
-                                 nullptr));
-      for (auto sess_iter = requesters.begin();
-           sess_iter != requesters.end();) {
-        auto &[sess, resq] = *sess_iter;
+    while (n_open > 0) {
+      size_t n_ready = epoll.wait(-1);
+      for (size_t k = 0; k < n_ready; k++) {
+        const epoll_event &event = epoll.event(k);
+        Session &sess = sessions[event.data.u64];
+        if (!sess.open) {
+          continue;
+        }
         try {
-          if (FD_ISSET(sess.handle(), &read_fds)) {
-            // 这里 do_read 之后还需要检查一下是否已经读完了，否则就会一直阻塞在
-            // select 上面
-            resq.do_read();
+          if (event.events & EPOLLOUT) {
+            sess.requester.do_write();
+          }
+          if (event.events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            sess.requester.do_read();
           }
-          if (!resq.has_requests()) {
-            shutdown(sess.handle(), SHUT_RDWR);
-            close(sess.handle());
-            FD_CLR(sess.handle(), &original_read_fds);
-            FD_CLR(sess.handle(), &original_write_fds);
-            sess_iter = requesters.erase(sess_iter);
+          if (!sess.requester.has_requests()) {
+            close_session(sess);
           } else {
-            sess_iter++;
+            update_interest(event.data.u64);
           }
         } catch (const std::exception &err) {
           ERROR(err.what());
-          close(sess.handle());
-          FD_CLR(sess.handle(), &original_read_fds);
-          FD_CLR(sess.handle(), &original_write_fds);
-          sess_iter = requesters.erase(sess_iter);
+          close_session(sess);
         }
       }
     }
@@ -189,10 +596,702 @@ void workload(std::string_view server_ip, uint16_t server_port, int n_clients) {
 
   total_requests += n_total_requests;
   total_fail_connections += n_fail_connections;
+  {
+    std::lock_guard lock{latency_mutex};
+    total_latency.merge(latency);
+  }
 
   INFO("[{}] all done", std::this_thread::get_id());
 }
 
+// resource usage of this process and of the server between construction
+// and stop()
+// the client usage is summed over `client_pids`, the coordinator passes itself
+// and its agents
+class UsageSampler {
+public:
+  explicit UsageSampler(pid_t server_pid,
+                        std::vector<pid_t> client_pids = {getpid()})
+      : server_pid(server_pid), client_pids(std::move(client_pids)),
+        client_before(read_client_stats()) {
+    if (server_pid != 0) {
+      server_before = read_process_stats(server_pid);
+      server_perf.emplace(server_pid);
+      server_perf->start();
+    }
+  }
+
+  void stop(benchmark_report &report) {
+    report.client_usage = read_client_stats() - client_before;
+    if (server_before) {
+      report.server_usage = read_process_stats(server_pid) - *server_before;
+      if (server_perf->available()) {
+        report.server_perf = server_perf->stop();
+      }
+    }
+  }
+
+private:
+  process_stats read_client_stats() const {
+    // not a default constructed one, its syscall counts are unknown
+    process_stats total = read_process_stats(client_pids.front());
+    for (size_t i = 1; i < client_pids.size(); i++) {
+      total = total + read_process_stats(client_pids[i]);
+    }
+    return total;
+  }
+
+  pid_t server_pid;
+  std::vector<pid_t> client_pids;
+  process_stats client_before;
+  std::optional<process_stats> server_before{};
+  std::optional<PerfCounters> server_perf{};
+};
+
+// newline terminated messages over the unix socket between the coordinator
+// and its agents, both sides block
+class ControlChannel {
+public:
+  explicit ControlChannel(int fd) : fd(fd) {}
+
+  void send(std::string_view message) {
+    std::string line = fmt::format("{}\n", message);
+    size_t written = 0;
+    while (written < line.size()) {
+      ssize_t n;
+      CHECK(n = ::write(fd, line.data() + written, line.size() - written));
+      written += n;
+    }
+  }
+
+  std::string receive() {
+    size_t end;
+    while ((end = buffer.find('\n')) == std::string::npos) {
+      std::array<char, 4096> chunk;
+      ssize_t n;
+      CHECK(n = ::read(fd, chunk.data(), chunk.size()));
+      if (n == 0) {
+        throw eof_error();
+      }
+      buffer.append(chunk.data(), n);
+    }
+    std::string message = buffer.substr(0, end);
+    buffer.erase(0, end + 1);
+    return message;
+  }
+
+private:
+  int fd;
+  // bytes following the last received message
+  std::string buffer{};
+};
+
+void log_usage(const benchmark_report &report) {
+  auto log_process = [&](std::string_view name, const process_stats &usage) {
+    std::string syscalls = "n/a";
+    if (usage.syscalls()) {
+      syscalls = fmt::format("{:.3f} read + {:.3f} write/request",
+                             report.per_request(*usage.read_syscalls),
+                             report.per_request(*usage.write_syscalls));
+    }
+    INFO("{} cpu: {:.1f}% ({:.1f}% user), {:.2f} us/request, context "
+         "switches: {:.3f} voluntary + {:.3f} involuntary/request, "
+         "syscalls: {}",
+         name, usage.cpu_time() / report.elapsed * 100,
+         usage.user_time / report.elapsed * 100,
+         report.per_request(usage.cpu_time() * 1e6),
+         report.per_request(usage.voluntary_switches),
+         report.per_request(usage.involuntary_switches), syscalls);
+  };
+  log_process("client", report.client_usage);
+  if (report.server_usage) {
+    log_process("server", *report.server_usage);
+  }
+  if (report.server_perf) {
+    const auto &perf = *report.server_perf;
+    INFO("server instructions: {:.0f}/request, cycles: {:.0f}/request, IPC: "
+         "{:.2f}, cache misses: {:.2f}/request",
+         report.per_request(perf.instructions),
+         report.per_request(perf.cycles),
+         perf.cycles > 0 ? static_cast<double>(perf.instructions) / perf.cycles
+                         : 0,
+         report.per_request(perf.cache_misses));
+  }
+}
+
+void log_report(const benchmark_report &report) {
+  INFO("fail connections: {}", report.fail_connections);
+  INFO("connect latency ({} connections): {}", report.connect_latency.count(),
+       report.connect_latency.latency_summary());
+  INFO("total requests: {}", report.requests);
+  INFO("throughput: {:.0f} requests/s", report.throughput());
+  INFO("latency ({} responses): {}", report.latency.count(),
+       report.latency.latency_summary());
+  log_usage(report);
+}
+
+// one row per run, read back by bench_matrix, the header is written when
+// the file is still empty
+void append_report(std::string_view protocol, const benchmark_options &options,
+                   const benchmark_report &report) {
+  FILE *file = fopen(options.report_file.c_str(), "a");
+  if (file == nullptr) {
+    THROW("failed to open report {}: {}", options.report_file,
+          get_errno_string(errno));
+  }
+  if (ftell(file) == 0) {
+    fmt::print(file, "protocol,transport,threads,clients,pipeline_depth,rate,"
+                     "requests,fail_connections,elapsed,throughput,p50_us,"
+                     "p90_us,p99_us,p999_us,max_us,client_cpu_us_per_request,"
+                     "server_cpu_us_per_request,server_switches_per_request,"
+                     "server_syscalls_per_request,"
+                     "server_instructions_per_request,"
+                     "server_cycles_per_request,connect_p50_us,"
+                     "connect_p99_us\n");
+  }
+  auto us = [&](double percentile) {
+    return report.latency.value_at_percentile(percentile) / 1000.0;
+  };
+  auto connect_us = [&](double percentile) {
+    return report.connect_latency.value_at_percentile(percentile) / 1000.0;
+  };
+  // shm is set up over a unix socket too
+  std::string_view transport =
+      options.server_endpoint.is_unix() ? "unix" : "tcp";
+  if (options.transport == "shm") {
+    transport = "shm";
+  }
+  // server columns are empty if unknown
+  std::string server_columns = ",,,,";
+  if (report.server_usage) {
+    const auto &usage = *report.server_usage;
+    auto syscalls = usage.syscalls();
+    server_columns = fmt::format(
+        "{:.3f},{:.3f},{},", report.per_request(usage.cpu_time() * 1e6),
+        report.per_request(usage.voluntary_switches +
+                           usage.involuntary_switches),
+        syscalls ? fmt::format("{:.3f}", report.per_request(*syscalls)) : "");
+    if (report.server_perf) {
+      server_columns +=
+          fmt::format("{:.0f},{:.0f}",
+                      report.per_request(report.server_perf->instructions),
+                      report.per_request(report.server_perf->cycles));
+    } else {
+      server_columns += ",";
+    }
+  }
+  fmt::print(file, "{},{},{},{},{},{},{},{},{:.3f},{:.1f},{:.1f},{:.1f},"
+                   "{:.1f},{:.1f},{:.1f},{:.3f},{},{:.1f},{:.1f}\n",
+             protocol, transport,
+             options.threads, options.clients, options.pipeline_depth,
+             options.rate, report.requests, report.fail_connections,
+             report.elapsed, report.throughput(),
+             us(50), us(90), us(99), us(99.9), report.latency.max() / 1000.0,
+             report.per_request(report.client_usage.cpu_time() * 1e6),
+             server_columns, connect_us(50), connect_us(99));
+  fclose(file);
+}
+
+benchmark_report run_benchmark(std::string_view protocol,
+                               const benchmark_options &options) {
+  total_fail_connections = 0;
+  total_requests = 0;
+  start = false;
+  finish = false;
+  connected_count = 0;
+  total_latency.reset();
+  total_connect_latency.reset();
+
+  INFO("wait for connection establishment");
+
+  uint16_t threads = options.threads;
+  std::vector<std::thread> workers;
+  with_codec(protocol, [&](auto codec) {
+    with_stream(options.transport, [&](auto stream) {
+      for (auto i = 0; i < threads; i++) {
+        // spread the clients evenly, the first ones get the remainder
+        int n_clients =
+            options.clients / threads + (i < options.clients % threads);
+        workers.push_back(
+            std::thread(workload<decltype(codec), decltype(stream)>,
+                        std::cref(options), n_clients,
+                        options.stream_offset + i));
+      }
+    });
+  });
+
+  // 这里主线程需要等待所有的工作线程创建好连接
+  std::mutex mutex;
+  std::unique_lock lock{mutex};
+  wait_connection.wait(
+      lock, [threads]() -> bool { return connected_count == threads; });
+  if (options.rate > 0) {
+    INFO("start benchmarking, open loop at {:.0f} requests/s", options.rate);
+  } else {
+    INFO("start benchmarking, closed loop, pipeline depth {}",
+         options.pipeline_depth);
+  }
+  if (options.control) {
+    // barrier of a coordinated run
+    options.control->send("ready");
+    if (options.control->receive() != "start") {
+      THROW("unexpected message from the coordinator");
+    }
+  }
+  // the usage covers the finish up phase as well, every counted request is
+  // answered by then
+  UsageSampler usage(options.server_pid);
+  start = true;
+  start_request.notify_all();
+
+  ch::steady_clock::time_point begin = ch::steady_clock::now();
+  TIMER_BEGIN("main stopwatch")
+  std::this_thread::sleep_for(ch::seconds(options.time));
+  TIMER_END()
+  finish = true;
+  benchmark_report report;
+  report.elapsed =
+      ch::duration<double>(ch::steady_clock::now() - begin).count();
+  for (auto &th : workers) {
+    th.join();
+  }
+  usage.stop(report);
+  report.fail_connections = total_fail_connections;
+  report.requests = total_requests;
+  report.latency = total_latency;
+  report.connect_latency = total_connect_latency;
+  log_report(report);
+  if (!options.report_file.empty()) {
+    append_report(protocol, options, report);
+  }
+  return report;
+}
+
+// a syscall count of an agent report, "-" if unknown
+static std::string encode_count(const std::optional<uint64_t> &count) {
+  return count ? std::to_string(*count) : "-";
+}
+
+static std::optional<uint64_t> decode_count(const std::string &text) {
+  if (text == "-") {
+    return std::nullopt;
+  }
+  return std::stoull(text);
+}
+
+// report of an agent as a single message: counters, usage and histograms,
+// the connect latency one is terminated by a '|'
+std::string encode_report(const benchmark_report &report) {
+  const process_stats &usage = report.client_usage;
+  return fmt::format("report {} {} {} {} {} {} {} {} {} {} | {}",
+                     report.requests, report.fail_connections, report.elapsed,
+                     usage.user_time, usage.system_time,
+                     usage.voluntary_switches, usage.involuntary_switches,
+                     encode_count(usage.read_syscalls),
+                     encode_count(usage.write_syscalls),
+                     report.connect_latency.encode(), report.latency.encode());
+}
+
+benchmark_report decode_report(std::string_view message) {
+  benchmark_report report;
+  process_stats &usage = report.client_usage;
+  std::istringstream stream{std::string(message)};
+  std::string tag, read_syscalls, write_syscalls;
+  if (!(stream >> tag >> report.requests >> report.fail_connections >>
+        report.elapsed >> usage.user_time >> usage.system_time >>
+        usage.voluntary_switches >> usage.involuntary_switches >>
+        read_syscalls >> write_syscalls) ||
+      tag != "report") {
+    throw program_error("malformed agent report: {}", message.substr(0, 64));
+  }
+  usage.read_syscalls = decode_count(read_syscalls);
+  usage.write_syscalls = decode_count(write_syscalls);
+  std::string histogram;
+  std::getline(stream, histogram, '|');
+  report.connect_latency = Histogram::decode(histogram);
+  std::getline(stream, histogram);
+  report.latency = Histogram::decode(histogram);
+  return report;
+}
+
+// Run as agent `index` of a coordinated run: take this agent's share of the
+// workload streams and of the rate, establish the connections, wait for the
+// start signal and send the report back.
+void run_agent(std::string_view protocol, benchmark_options options,
+               const std::string &control_path) {
+  int fd;
+  CHECK(fd = ::socket(AF_UNIX, SOCK_STREAM, 0));
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, control_path.c_str(),
+          sizeof(address.sun_path) - 1);
+  CHECK(::connect(fd, reinterpret_cast<sockaddr *>(&address),
+                  sizeof(address)));
+  ControlChannel control(fd);
+  size_t index, n_agents;
+  std::istringstream hello{control.receive()};
+  std::string tag;
+  if (!(hello >> tag >> index >> n_agents) || tag != "agent") {
+    THROW("unexpected message from the coordinator");
+  }
+  INFO("agent {} of {}", index, n_agents);
+  options.stream_offset = index * options.threads;
+  options.stream_count = n_agents * options.threads;
+  options.rate /= n_agents;
+  options.connect_rate /= n_agents;
+  options.control = &control;
+  // the coordinator samples the server and writes the report
+  options.server_pid = 0;
+  options.report_file.clear();
+  benchmark_report report = run_benchmark(protocol, options);
+  control.send(encode_report(report));
+  // the coordinator reads our usage from procfs before we may exit
+  if (control.receive() != "exit") {
+    THROW("unexpected message from the coordinator");
+  }
+  close(fd);
+}
+
+// Spawn `n_agents` copies of this program as agents (or wait for as many
+// started by hand with --coordinator), start them at once when all of them
+// have established their connections, and merge their reports.
+benchmark_report run_coordinator(std::string_view protocol,
+                                 const benchmark_options &options,
+                                 size_t n_agents, bool spawn,
+                                 const std::string &control_path,
+                                 const std::vector<std::string> &agent_args) {
+  int listen_fd;
+  CHECK(listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (control_path.size() >= sizeof(address.sun_path)) {
+    THROW("control socket path too long: {}", control_path);
+  }
+  strncpy(address.sun_path, control_path.c_str(),
+          sizeof(address.sun_path) - 1);
+  ::unlink(control_path.c_str());
+  CHECK(::bind(listen_fd, reinterpret_cast<sockaddr *>(&address),
+               sizeof(address)));
+  CHECK(::listen(listen_fd, n_agents));
+  INFO("coordinator listens on {}, {} agents", control_path, n_agents);
+
+  std::vector<pid_t> children;
+  if (spawn) {
+    for (size_t i = 0; i < n_agents; i++) {
+      std::vector<char *> argv;
+      for (const auto &arg : agent_args) {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+      }
+      argv.push_back(nullptr);
+      pid_t pid;
+      CHECK(pid = fork());
+      if (pid == 0) {
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
+      }
+      children.push_back(pid);
+    }
+  }
+
+  std::vector<int> fds;
+  std::vector<std::unique_ptr<ControlChannel>> agents;
+  // the client usage covers the coordinator and every agent
+  std::vector<pid_t> client_pids{getpid()};
+  for (size_t i = 0; i < n_agents; i++) {
+    pollfd pfd{listen_fd, POLLIN, 0};
+    int n_ready;
+    CHECK(n_ready = ::poll(&pfd, 1, 30000));
+    if (n_ready == 0) {
+      THROW("only {} of {} agents connected", i, n_agents);
+    }
+    int fd;
+    CHECK(fd = ::accept(listen_fd, nullptr, nullptr));
+    fds.push_back(fd);
+    // agents started by hand are not our children
+    ucred peer{};
+    socklen_t size = sizeof(peer);
+    CHECK(::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &size));
+    client_pids.push_back(peer.pid);
+    agents.push_back(std::make_unique<ControlChannel>(fd));
+    agents.back()->send(fmt::format("agent {} {}", i, n_agents));
+  }
+  for (auto &agent : agents) {
+    if (agent->receive() != "ready") {
+      THROW("unexpected message from an agent");
+    }
+  }
+  INFO("all agents connected, start benchmarking");
+  UsageSampler usage(options.server_pid, client_pids);
+  for (auto &agent : agents) {
+    agent->send("start");
+  }
+
+  benchmark_report report;
+  for (auto &agent : agents) {
+    benchmark_report part = decode_report(agent->receive());
+    report.requests += part.requests;
+    report.fail_connections += part.fail_connections;
+    report.elapsed = std::max(report.elapsed, part.elapsed);
+    report.latency.merge(part.latency);
+    report.connect_latency.merge(part.connect_latency);
+  }
+  usage.stop(report);
+  for (auto &agent : agents) {
+    agent->send("exit");
+  }
+
+  for (int fd : fds) {
+    close(fd);
+  }
+  close(listen_fd);
+  ::unlink(control_path.c_str());
+  for (pid_t pid : children) {
+    waitpid(pid, nullptr, 0);
+  }
+
+  log_report(report);
+  if (!options.report_file.empty()) {
+    benchmark_options total = options;
+    total.threads *= n_agents;
+    total.clients *= n_agents;
+    append_report(protocol, total, report);
+  }
+  return report;
+}
+
+struct churn_report {
+  int connections{};
+  int fail_connections{};
+  double elapsed{};
+  // from the start of connect() to the established connection
+  Histogram connect_latency{};
+  // from the start of connect() to the response, i.e. what a client with a
+  // connection per request sees
+  Histogram latency{};
+  uint64_t listen_overflows{};
+  uint64_t listen_drops{};
+  size_t peak_time_wait{};
+
+  double connection_rate() const { return connections / elapsed; }
+};
+
+// open a connection, send one request, wait for the response and close it,
+// as fast as possible until `finish`
+template <typename Codec>
+void churn_workload(const benchmark_options &options, uint32_t seed,
+                    churn_report &report) {
+  WorkloadStream stream(*options.workload, seed, seed,
+                        options.stream_count ? options.stream_count
+                                             : options.threads);
+  // a full accept queue makes connect() retransmit its SYN for minutes,
+  // bound it (and the response) so that the run still ends in time
+  timeval timeout{1, 0};
+  SocketOptions socket_options = options.socket_options;
+  if (options.linger >= 0) {
+    socket_options.linger = options.linger;
+  }
+  while (!finish) {
+    ch::steady_clock::time_point begin = ch::steady_clock::now();
+    int fd = -1;
+    try {
+      Client client{options.server_endpoint, socket_options};
+      fd = client.handle();
+      CHECK(setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                       sizeof(timeout)));
+      CHECK(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                       sizeof(timeout)));
+      client.connect();
+      report.connect_latency.record(
+          ch::duration_cast<ch::nanoseconds>(ch::steady_clock::now() - begin)
+              .count());
+      BasicRequester<Codec> requester{fd};
+      requester.do_request(stream.next());
+      while (requester.has_unsent() && !finish) {
+        requester.do_write();
+      }
+      while (requester.has_requests() && !finish) {
+        requester.do_read();
+      }
+      if (requester.has_requests()) {
+        throw program_error("no response before the end of the run");
+      }
+      report.latency.record(
+          ch::duration_cast<ch::nanoseconds>(ch::steady_clock::now() - begin)
+              .count());
+      report.connections++;
+    } catch (const std::exception &err) {
+      int n_fail = ++report.fail_connections;
+      // only every power of two, failures tend to come in floods
+      if ((n_fail & (n_fail - 1)) == 0) {
+        ERROR("[{}] {} failed connections, last: {}",
+              std::this_thread::get_id(), n_fail, err.what());
+      }
+    }
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+}
+
+churn_report run_churn(std::string_view protocol,
+                       const benchmark_options &options) {
+  finish = false;
+  std::vector<churn_report> reports(options.threads);
+  std::vector<std::thread> workers;
+
+  auto tcp_ext_before = read_tcp_ext_counters();
+  INFO("start churn benchmarking, {} threads, SO_LINGER {}", options.threads,
+       options.linger >= 0 ? fmt::format("{} s", options.linger)
+                           : std::string("disabled"));
+  ch::steady_clock::time_point begin = ch::steady_clock::now();
+  with_codec(protocol, [&](auto codec) {
+    for (auto i = 0; i < options.threads; i++) {
+      workers.push_back(std::thread(churn_workload<decltype(codec)>,
+                                    std::cref(options), i,
+                                    std::ref(reports[i])));
+    }
+  });
+
+  churn_report report;
+  // closed connections pile up in TIME_WAIT on the side closing first
+  auto end = begin + ch::seconds(options.time);
+  while (ch::steady_clock::now() < end) {
+    report.peak_time_wait =
+        std::max(report.peak_time_wait, read_time_wait_count());
+    std::this_thread::sleep_for(ch::milliseconds(100));
+  }
+  finish = true;
+  report.elapsed =
+      ch::duration<double>(ch::steady_clock::now() - begin).count();
+  for (auto &th : workers) {
+    th.join();
+  }
+  auto tcp_ext_after = read_tcp_ext_counters();
+  report.listen_overflows =
+      tcp_ext_after["ListenOverflows"] - tcp_ext_before["ListenOverflows"];
+  report.listen_drops =
+      tcp_ext_after["ListenDrops"] - tcp_ext_before["ListenDrops"];
+  for (const auto &r : reports) {
+    report.connections += r.connections;
+    report.fail_connections += r.fail_connections;
+    report.connect_latency.merge(r.connect_latency);
+    report.latency.merge(r.latency);
+  }
+
+  INFO("connections: {}, failed: {}", report.connections,
+       report.fail_connections);
+  INFO("connection rate: {:.0f} connections/s", report.connection_rate());
+  INFO("connect latency: {}", report.connect_latency.latency_summary());
+  INFO("request latency (including connect): {}",
+       report.latency.latency_summary());
+  INFO("accept queue overflows: {}, listen drops: {}", report.listen_overflows,
+       report.listen_drops);
+  INFO("TIME_WAIT sockets: peak {}, at the end {}", report.peak_time_wait,
+       read_time_wait_count());
+  return report;
+}
+
+// Step the open loop rate up until the server stops keeping up, i.e. the
+// achieved throughput falls behind the offered rate or p99 latency explodes
+// compared to the first step, the last rate before that is the knee.
+void find_knee(std::string_view protocol, benchmark_options options,
+               double rate_step) {
+  constexpr double min_achieved_ratio = 0.95;
+  constexpr double max_p99_ratio = 10;
+  constexpr int max_steps = 32;
+  if (options.rate <= 0) {
+    options.rate = 1000;
+  }
+  std::optional<double> knee;
+  uint64_t base_p99 = 0;
+  std::vector<std::string> lines;
+  for (int i = 0; i < max_steps; i++) {
+    benchmark_report report = run_benchmark(protocol, options);
+    uint64_t p99 = report.latency.value_at_percentile(99);
+    if (i == 0) {
+      base_p99 = std::max<uint64_t>(p99, 1);
+    }
+    lines.emplace_back(fmt::format("offered: {:.0f} requests/s, achieved: "
+                                   "{:.0f} requests/s, {}",
+                                   options.rate, report.throughput(),
+                                   report.latency.latency_summary()));
+    if (report.throughput() < options.rate * min_achieved_ratio ||
+        p99 > base_p99 * max_p99_ratio) {
+      break;
+    }
+    knee = options.rate;
+    options.rate *= rate_step;
+  }
+  for (const auto &line : lines) {
+    INFO("{}", line);
+  }
+  if (knee) {
+    INFO("saturation knee: {:.0f} requests/s", *knee);
+  } else {
+    INFO("server saturated already at {:.0f} requests/s", options.rate);
+  }
+}
+
+// the command line of a spawned agent: ours without the options only the
+// coordinator acts on
+std::vector<std::string> agent_arguments(int argc, char **argv,
+                                         const std::string &control_path) {
+  static const std::vector<std::string_view> with_value{
+      "--agents", "--control", "--server-pid", "--report"};
+  std::vector<std::string> args{argv[0]};
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (arg == "--no-spawn") {
+      continue;
+    }
+    auto option = std::find_if(
+        with_value.begin(), with_value.end(), [arg](std::string_view name) {
+          return arg == name || (arg.substr(0, name.size()) == name &&
+                                 arg.substr(name.size(), 1) == "=");
+        });
+    if (option != with_value.end()) {
+      // skip the value too, unless given as --option=value
+      i += arg == *option ? 1 : 0;
+      continue;
+    }
+    args.emplace_back(arg);
+  }
+  args.emplace_back("--coordinator");
+  args.push_back(control_path);
+  return args;
+}
+
+// every connection is a fd, lift the soft limit as far as the hard limit
+// allows so that 100k+ clients do not fail with EMFILE
+void raise_fd_limit() {
+  rlimit limit{};
+  CHECK(getrlimit(RLIMIT_NOFILE, &limit));
+  if (limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    CHECK(setrlimit(RLIMIT_NOFILE, &limit));
+  }
+  INFO("open file limit: {}", limit.rlim_cur);
+}
+
+// Run once per pipeline depth 1, 2, 4, ... up to `max_depth`, more requests
+// in flight raise the throughput until the server saturates, after that they
+// only add queueing delay.
+void sweep_pipeline(std::string_view protocol, benchmark_options options,
+                    int max_depth) {
+  std::vector<std::string> lines;
+  for (int depth = 1; depth <= max_depth; depth *= 2) {
+    options.pipeline_depth = depth;
+    benchmark_report report = run_benchmark(protocol, options);
+    lines.emplace_back(fmt::format("pipeline depth: {}, throughput: {:.0f} "
+                                   "requests/s, {}",
+                                   depth, report.throughput(),
+                                   report.latency.latency_summary()));
+  }
+  for (const auto &line : lines) {
+    INFO("{}", line);
+  }
+}
+
 int main(int argc, char **argv) {
 
   argparse::ArgumentParser parser(fs::path(argv[0]).filename());
@@ -201,6 +1300,14 @@ int main(int argc, char **argv) {
   parser.add_argument("--server-port", "-p")
       .default_value<uint16_t>(7814)
       .scan<'i', uint16_t>();
+  parser.add_argument("--unix-socket")
+      .metavar("PATH")
+      .help("connect to this unix domain socket instead of --server-ip and "
+            "--server-port, to compare against TCP over loopback");
+  parser.add_argument("--transport")
+      .default_value<std::string>("socket")
+      .help("socket, or shm: a shared memory ring pair per connection, set "
+            "up over --unix-socket (needs --pipeline-depth > 0)");
   parser.add_argument("--thread", "-n")
       .default_value<uint16_t>(1)
       .scan<'i', uint16_t>()
@@ -210,10 +1317,136 @@ int main(int argc, char **argv) {
       .scan<'i', uint16_t>()
       .metavar("UINT");
   parser.add_argument("--client", "-c")
-      .default_value<uint16_t>(1000)
-      .scan<'i', uint16_t>()
+      .default_value<int>(1000)
+      .scan<'i', int>()
       .metavar("UINT")
       .help("specify the number of clients");
+  parser.add_argument("--pipeline-depth")
+      .default_value<int>(1)
+      .scan<'i', int>()
+      .metavar("UINT")
+      .help("requests in flight per connection, 0 means unbounded");
+  parser.add_argument("--pipeline-sweep")
+      .default_value<bool>(false)
+      .implicit_value(true)
+      .help("run with pipeline depths 1, 2, 4, ... up to --pipeline-depth");
+  parser.add_argument("--operands")
+      .default_value<size_t>(2)
+      .scan<'u', size_t>()
+      .metavar("UINT")
+      .help("operands per (parenthesised) sub expression");
+  parser.add_argument("--depth")
+      .default_value<size_t>(0)
+      .scan<'u', size_t>()
+      .metavar("UINT")
+      .help("nesting depth of parentheses");
+  parser.add_argument("--multiply-ratio")
+      .default_value<double>(0.0)
+      .scan<'g', double>()
+      .metavar("RATIO")
+      .help("fraction of '*' among the operators, the rest is '+'");
+  parser.add_argument("--operand-digits")
+      .default_value<size_t>(6)
+      .scan<'u', size_t>()
+      .metavar("1-9")
+      .help("decimal digits per operand");
+  parser.add_argument("--keys")
+      .default_value<size_t>(1 << 20)
+      .scan<'u', size_t>()
+      .metavar("UINT")
+      .help("distinct expressions generated up front");
+  parser.add_argument("--hot-ratio")
+      .default_value<double>(0.0)
+      .scan<'g', double>()
+      .metavar("RATIO")
+      .help("fraction of requests repeating one of the --hot-keys "
+            "expressions");
+  parser.add_argument("--hot-keys")
+      .default_value<size_t>(64)
+      .scan<'u', size_t>()
+      .metavar("UINT");
+  parser.add_argument("--trace")
+      .help("replay the expressions of this file, one per line, optionally "
+            "followed by '=<value>', instead of generating them");
+  parser.add_argument("--churn")
+      .default_value<bool>(false)
+      .implicit_value(true)
+      .help("open a connection per request from every thread as fast as "
+            "possible, --client is ignored");
+  parser.add_argument("--linger")
+      .default_value<int>(-1)
+      .scan<'i', int>()
+      .metavar("SECONDS")
+      .help("churn mode: enable SO_LINGER with this timeout, 0 resets the "
+            "connection on close instead of leaving it in TIME_WAIT (-1 "
+            "means disabled)");
+  parser.add_argument("--server-pid")
+      .default_value<int>(0)
+      .scan<'i', int>()
+      .metavar("PID")
+      .help("sample cpu time, context switches, syscalls and (if allowed) "
+            "perf counters of the server process during each run");
+  parser.add_argument("--agents")
+      .default_value<int>(0)
+      .scan<'i', int>()
+      .metavar("UINT")
+      .help("coordinate this many agent processes, each running --thread "
+            "threads with --client connections, and merge their results");
+  parser.add_argument("--no-spawn")
+      .default_value<bool>(false)
+      .implicit_value(true)
+      .help("do not spawn the agents, wait for them to be started with "
+            "--coordinator");
+  parser.add_argument("--control")
+      .metavar("PATH")
+      .help("unix socket of the coordinator (default: "
+            "/tmp/benchmark_calculator.<pid>.sock)");
+  parser.add_argument("--coordinator")
+      .metavar("PATH")
+      .help("run as agent of the coordinator listening on this unix "
+            "socket");
+  parser.add_argument("--report")
+      .metavar("PATH")
+      .help("append a csv row with the results of every run to this file");
+  parser.add_argument("--protocol")
+      .default_value<std::string>("text")
+      .help("wire protocol: text, binary or batch");
+  parser.add_argument("--socket-options")
+      .default_value<std::string>("default")
+      .metavar("PRESET")
+      .help("socket options of the connections: default, low-latency or "
+            "throughput");
+  parser.add_argument("--connects-in-flight")
+      .default_value<int>(64)
+      .scan<'i', int>()
+      .metavar("UINT")
+      .help("non-blocking connects in flight per thread while establishing "
+            "the connections");
+  parser.add_argument("--connect-rate")
+      .default_value<double>(0.0)
+      .scan<'g', double>()
+      .metavar("CONN/S")
+      .help("aggregate rate connects are started at, 0 means as fast as "
+            "--connects-in-flight allows");
+  parser.add_argument("--rate", "-r")
+      .default_value<double>(0.0)
+      .scan<'g', double>()
+      .metavar("REQ/S")
+      .help("open loop: aggregate requests per second, latency is measured "
+            "from the intended send time (0 means closed loop)");
+  parser.add_argument("--arrival")
+      .default_value<std::string>("poisson")
+      .help("arrival process of the open loop: poisson or uniform");
+  parser.add_argument("--find-knee")
+      .default_value<bool>(false)
+      .implicit_value(true)
+      .help("step the open loop rate up from --rate until the server "
+            "saturates");
+  parser.add_argument("--rate-step")
+      .default_value<double>(1.5)
+      .scan<'g', double>()
+      .metavar("FACTOR")
+      .help("factor the rate is multiplied with per step of --find-knee");
 
   signal(SIGPIPE, SIG_IGN);
 
@@ -224,38 +1457,100 @@ int main(int argc, char **argv) {
     fmt::print("{}", parser);
   }
 
-  INFO("wait for connection establishment");
-
-  uint16_t threads = parser.get<uint16_t>("--thread");
-  std::vector<std::thread> workers;
-  int total_clients = parser.get<uint16_t>("--client");
-  int n_clients =
-      static_cast<int>(ceil(total_clients / static_cast<float>(threads)));
-  finish = false;
-  for (auto i = 0; i < threads; i++) {
-    workers.push_back(std::thread(workload,
-                                  parser.get<std::string>("--server-ip"),
-                                  parser.get<uint16_t>("--server-port"),
-                                  std::min(total_clients, n_clients)));
-    total_clients -= n_clients;
-  }
-
-  // 这里主线程需要等待所有的工作线程创建好连接
-  std::mutex mutex;
-  std::unique_lock lock{mutex};
-  wait_connection.wait(
-      lock, [threads]() -> bool { return connected_count == threads; });
-  INFO("start benchmarking");
-  start = true;
-  start_request.notify_all();
-
-  TIMER_BEGIN("main stopwatch")
-  std::this_thread::sleep_for(ch::seconds(parser.get<uint16_t>("--time")));
-  TIMER_END()
-  finish = true;
-  for (auto &th : workers) {
-    th.join();
+  try {
+    raise_fd_limit();
+    benchmark_options options;
+    options.server_endpoint =
+        Endpoint{parser.get<std::string>("--server-ip"),
+                 parser.get<uint16_t>("--server-port")};
+    if (auto unix_socket = parser.present("--unix-socket")) {
+      options.server_endpoint = Endpoint::unix_socket(*unix_socket);
+    }
+    options.threads = parser.get<uint16_t>("--thread");
+    options.clients = parser.get<int>("--client");
+    if (options.threads == 0 || options.clients < options.threads) {
+      THROW("every thread needs a client: {} threads, {} clients",
+            options.threads, options.clients);
+    }
+    options.time = parser.get<uint16_t>("--time");
+    options.rate = parser.get<double>("--rate");
+    std::string arrival = parser.get<std::string>("--arrival");
+    if (arrival == "poisson") {
+      options.arrival = arrival_type::poisson;
+    } else if (arrival == "uniform") {
+      options.arrival = arrival_type::uniform;
+    } else {
+      THROW("unknown arrival process: {}", arrival);
+    }
+    options.pipeline_depth = parser.get<int>("--pipeline-depth");
+    if (options.pipeline_depth < 0) {
+      THROW("invalid pipeline depth: {}", options.pipeline_depth);
+    }
+    std::unique_ptr<Workload> workload;
+    if (auto trace = parser.present("--trace")) {
+      workload = std::make_unique<TraceWorkload>(*trace);
+    } else {
+      workload_profile profile;
+      profile.operands = parser.get<size_t>("--operands");
+      profile.depth = parser.get<size_t>("--depth");
+      profile.multiply_ratio = parser.get<double>("--multiply-ratio");
+      profile.operand_digits = parser.get<size_t>("--operand-digits");
+      profile.keys = parser.get<size_t>("--keys");
+      profile.hot_ratio = parser.get<double>("--hot-ratio");
+      profile.hot_keys = parser.get<size_t>("--hot-keys");
+      workload = std::make_unique<GeneratedWorkload>(profile, 0);
+    }
+    options.workload = workload.get();
+    if (auto report = parser.present("--report")) {
+      options.report_file = *report;
+    }
+    std::string protocol = parser.get<std::string>("--protocol");
+    options.server_pid = parser.get<int>("--server-pid");
+    options.churn = parser.get<bool>("--churn");
+    options.transport = parser.get<std::string>("--transport");
+    if (options.transport == "shm") {
+      // writable rings give no back pressure like a full socket buffer does
+      if (!options.server_endpoint.is_unix() || options.churn ||
+          options.pipeline_depth == 0) {
+        THROW("--transport shm needs --unix-socket and --pipeline-depth > 0, "
+              "and does not churn");
+      }
+    }
+    options.linger = parser.get<int>("--linger");
+    options.socket_options =
+        SocketOptions::preset(parser.get<std::string>("--socket-options"));
+    options.connects_in_flight = parser.get<int>("--connects-in-flight");
+    if (options.connects_in_flight <= 0) {
+      THROW("invalid connects in flight: {}", options.connects_in_flight);
+    }
+    options.connect_rate = parser.get<double>("--connect-rate");
+    int n_agents = parser.get<int>("--agents");
+    if (auto coordinator = parser.present("--coordinator")) {
+      run_agent(protocol, options, *coordinator);
+    } else if (n_agents > 0) {
+      if (options.churn || parser.get<bool>("--pipeline-sweep") ||
+          parser.get<bool>("--find-knee")) {
+        THROW("--agents only supports a single closed or open loop run");
+      }
+      std::string control_path = parser.present("--control").value_or(
+          fmt::format("/tmp/benchmark_calculator.{}.sock", getpid()));
+      run_coordinator(protocol, options, n_agents,
+                      !parser.get<bool>("--no-spawn"), control_path,
+                      agent_arguments(argc, argv, control_path));
+    } else if (options.churn) {
+      run_churn(protocol, options);
+    } else if (parser.get<bool>("--pipeline-sweep")) {
+      if (options.pipeline_depth == 0) {
+        THROW("--pipeline-sweep needs a bounded --pipeline-depth");
+      }
+      sweep_pipeline(protocol, options, options.pipeline_depth);
+    } else if (parser.get<bool>("--find-knee")) {
+      find_knee(protocol, options, parser.get<double>("--rate-step"));
+    } else {
+      run_benchmark(protocol, options);
+    }
+  } catch (const std::exception &e) {
+    ERROR(e.what());
+    exit(-1);
   }
-  INFO("fail connections: {}", static_cast<int>(total_fail_connections));
-  INFO("total requests: {}", static_cast<int>(total_requests));
-}
\ No newline at end of file
+}
@@ -1,7 +1,11 @@
 #include "sync_calculator/responser.hpp"
+#include "sync_calculator/service_arguments.hpp"
 #include "utils/common.hpp"
 #include "utils/exceptions.hpp"
+#include "utils/loop_monitor.hpp"
+#include "utils/metrics.hpp"
 #include "utils/server.hpp"
+#include "utils/trace.hpp"
 
 #include <exception>
 #include <signal.h>
@@ -13,21 +17,17 @@
 #include <filesystem>
 #include <unordered_set>
 
-void server(std::string_view server_ip, uint16_t server_port,
-            int backlog_size) {
-  Server s{server_ip, server_port};
+// `Stream` is SocketStream, or ShmChannel with `shm_ring_size` bytes per
+// direction, see with_stream()
+template <typename Codec, typename Stream>
+void server(const Endpoint &endpoint, int backlog_size,
+            const SocketOptions &socket_options, size_t shm_ring_size,
+            const loop_monitor_options &monitor_options,
+            std::chrono::milliseconds tcp_info_interval) {
+  using Responser = BasicResponser<Codec, FixedBuffer<1024>, Stream>;
+  Server s{endpoint, socket_options};
   s.bind().listen(backlog_size);
   // set_fd_status_flag(s.handle(), O_NONBLOCK);
-  {
-    int reuseaddr = 1;
-    CHECK(setsockopt(s.handle(), SOL_SOCKET, SO_REUSEADDR, &reuseaddr,
-                     sizeof(reuseaddr)));
-  }
-  {
-    int reuseport = 1;
-    CHECK(setsockopt(s.handle(), SOL_SOCKET, SO_REUSEPORT, &reuseport,
-                     sizeof(reuseport)));
-  }
 
   fd_set original_read_fds, original_write_fds, read_fds, write_fds;
   int max_fd_number = -1;
@@ -43,45 +43,89 @@ void server(std::string_view server_ip, uint16_t server_port,
 
   // we have to wait on s.handle()、
   std::unordered_map<Session, Responser> responsers;
+  const auto &metrics = get_server_metrics();
+  LoopMonitor monitor{monitor_options};
+  auto next_tcp_info = std::chrono::steady_clock::now() + tcp_info_interval;
 
   while (true) {
     try {
-      if (!responsers.empty()) {
+      max_fd_number = s.handle();
+      for (const auto &[sess, resp] : responsers) {
         max_fd_number =
-            std::max_element(
-                responsers.begin(), responsers.end(),
-                [](const std::pair<Session, Responser> &a,
-                   const std::pair<Session, Responser> &&b) -> bool {
-                  return a.first.handle() < b.first.handle();
-                })
-                ->first.handle();
-      } else {
-        max_fd_number = -1;
+            std::max({max_fd_number, sess.handle(), resp.handle()});
       }
-      max_fd_number = std::max(max_fd_number, s.handle());
       if (prev_max_fd_number != max_fd_number) {
         prev_max_fd_number = max_fd_number;
       }
       memcpy(&read_fds, &original_read_fds, sizeof(original_read_fds));
       memcpy(&write_fds, &original_write_fds, sizeof(original_write_fds));
       // build fd_set for select
+      // wake up for the next tcp_info sampling even if idle
+      struct timeval timeout {};
+      struct timeval *select_timeout = nullptr;
+      if (tcp_info_interval.count()) {
+        auto remaining = std::max<std::chrono::microseconds>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                next_tcp_info - std::chrono::steady_clock::now()),
+            std::chrono::microseconds(0));
+        timeout.tv_sec = remaining.count() / 1000000;
+        timeout.tv_usec = remaining.count() % 1000000;
+        select_timeout = &timeout;
+      }
       int n_ready_fds;
-      CHECK(n_ready_fds = select(max_fd_number + 1, &read_fds, &write_fds,
-                                 nullptr, nullptr));
+      {
+        TRACE_SCOPE("select");
+        n_ready_fds = select(max_fd_number + 1, &read_fds, &write_fds,
+                             nullptr, select_timeout);
+      }
+      // a late SIGUSR2 of the watchdog
+      if (n_ready_fds == -1 && errno == EINTR) {
+        continue;
+      }
+      CHECK(n_ready_fds);
+      monitor.begin_iteration();
+      metrics.ready_fds.set(n_ready_fds);
       // The return value may be zero if the timeout expired
       // before any file descriptors became ready.
       // loop through all
       // check for new connections
       if (FD_ISSET(s.handle(), &read_fds)) {
         try {
+          TRACE_SCOPE("accept");
+          auto callback = monitor.callback("accept", s.local_endpoint());
           Session sess = s.accept();
-          if (responsers.size() < 1000) {
-            responsers.emplace(sess, Responser(sess.handle()));
-            FD_SET(sess.handle(), &original_read_fds);
-            FD_SET(sess.handle(), &original_write_fds);
+          metrics.connections_accepted.add();
+          // FD_SET on an fd at or above FD_SETSIZE writes past the fd_set
+          if (responsers.size() < 1000 && sess.handle() < FD_SETSIZE) {
+            Responser resp;
+            if constexpr (std::is_same_v<Stream, ShmChannel>) {
+              try {
+                resp = Responser(ShmChannel::accept(sess.handle(),
+                                                    shm_ring_size));
+                // a shm connection holds two eventfds besides the socket
+                if (resp.handle() >= FD_SETSIZE) {
+                  THROW("max connection reached, doorbell fd {} is beyond "
+                        "FD_SETSIZE",
+                        resp.handle());
+                }
+              } catch (...) {
+                close(sess.handle());
+                metrics.connections_closed.add();
+                throw;
+              }
+              // the unix socket is only readable once the client is gone
+              FD_SET(sess.handle(), &original_read_fds);
+            } else {
+              resp = Responser(sess.handle());
+            }
+            FD_SET(resp.handle(), &original_read_fds);
+            FD_SET(resp.handle(), &original_write_fds);
+            responsers.emplace(sess, std::move(resp));
+            metrics.connections.add(1);
           } else {
             INFO("max connection reached, abort!");
             close(sess.handle());
+            metrics.connections_closed.add();
           }
         } catch (const std::exception &err) {
           ERROR(err.what());
@@ -90,24 +134,46 @@ void server(std::string_view server_ip, uint16_t server_port,
 
       // then we have to loop through all sessions
       // perform read & write
+      size_t pending_responses = 0;
       for (auto sess_iter = responsers.begin();
            sess_iter != responsers.end();) {
         auto &[sess, resp] = *sess_iter;
         try {
-          if (FD_ISSET(sess.handle(), &read_fds)) {
-            responsers[sess].do_read();
+          if (FD_ISSET(resp.handle(), &read_fds)) {
+            auto callback = monitor.callback("do_read", sess.remote_endpoint());
+            resp.do_read();
           }
-          if (FD_ISSET(sess.handle(), &write_fds)) {
-            responsers[sess].do_write();
+          if (FD_ISSET(resp.handle(), &write_fds)) {
+            auto callback =
+                monitor.callback("do_write", sess.remote_endpoint());
+            resp.do_write();
           }
+          if (resp.handle() != sess.handle() &&
+              FD_ISSET(sess.handle(), &read_fds)) {
+            throw eof_error();
+          }
+          pending_responses += resp.pending_responses();
           sess_iter++;
         } catch (const std::exception &err) {
           close(sess.handle());
           FD_CLR(sess.handle(), &original_read_fds);
           FD_CLR(sess.handle(), &original_write_fds);
+          FD_CLR(resp.handle(), &original_read_fds);
+          FD_CLR(resp.handle(), &original_write_fds);
           sess_iter = responsers.erase(sess_iter);
+          metrics.connections_closed.add();
+          metrics.connections.add(-1);
+        }
+      }
+      metrics.pending_responses.set(pending_responses);
+      if (tcp_info_interval.count() &&
+          std::chrono::steady_clock::now() >= next_tcp_info) {
+        for (const auto &[sess, resp] : responsers) {
+          sample_tcp_info(sess);
         }
+        next_tcp_info = std::chrono::steady_clock::now() + tcp_info_interval;
       }
+      metrics.loop_iteration.record(monitor.end_iteration().count());
 
     } catch (const std::exception &err) {
       ERROR(err.what());
@@ -120,14 +186,28 @@ namespace fs = std::filesystem;
 
 int main(int argc, char **argv) {
   argparse::ArgumentParser parser(fs::path(argv[0]).filename());
-  parser.add_argument("--server-ip", "-s")
-      .default_value<std::string>("127.0.0.1");
-  parser.add_argument("--server-port", "-p")
-      .default_value<uint16_t>(7814)
-      .scan<'i', uint16_t>();
-  parser.add_argument("--backlog-size", "-b")
-      .default_value<int>(1)
-      .scan<'i', int>();
+  add_service_arguments(parser);
+  parser.add_argument("--transport")
+      .default_value<std::string>("socket")
+      .help("socket, or shm: a shared memory ring pair per client, set up "
+            "over --unix-socket");
+  parser.add_argument("--shm-ring-size")
+      .default_value<size_t>(size_t{ShmChannel::default_ring_size})
+      .scan<'u', size_t>()
+      .metavar("BYTES")
+      .help("bytes per direction of a shm connection, a power of two");
+  parser.add_argument("--loop-budget")
+      .default_value<size_t>(10000)
+      .scan<'u', size_t>()
+      .metavar("US")
+      .help("count and log event loop iterations and callbacks taking longer "
+            "(0 means disabled)");
+  parser.add_argument("--watchdog-deadline")
+      .default_value<size_t>(1000)
+      .scan<'u', size_t>()
+      .metavar("MS")
+      .help("print a backtrace of the event loop when an iteration takes "
+            "longer (0 means disabled)");
 
   signal(SIGPIPE, SIG_IGN);
 
@@ -139,12 +219,26 @@ int main(int argc, char **argv) {
   }
 
   try {
-    std::string server_ip = parser.get<std::string>("--server-ip");
-    uint16_t server_port = parser.get<uint16_t>("--server-port");
-    server(server_ip, server_port, parser.get<int>("--backlog-size"));
+    service_context context = apply_service_arguments(parser);
+    std::string transport = parser.get<std::string>("--transport");
+    if (transport == "shm" && !context.endpoint.is_unix()) {
+      THROW("--transport shm needs --unix-socket");
+    }
+    with_codec(parser.get<std::string>("--protocol"), [&](auto codec) {
+      with_stream(transport, [&](auto stream) {
+        server<decltype(codec), decltype(stream)>(
+            context.endpoint, parser.get<int>("--backlog-size"),
+            context.socket_options, parser.get<size_t>("--shm-ring-size"),
+            {std::chrono::microseconds(parser.get<size_t>("--loop-budget")),
+             std::chrono::milliseconds(
+                 parser.get<size_t>("--watchdog-deadline"))},
+            std::chrono::milliseconds(
+                parser.get<size_t>("--tcp-info-interval")));
+      });
+    });
   } catch (const std::exception &e) {
     ERROR(e.what());
     exit(-1);
   }
   return 0;
-}
\ No newline at end of file
+}
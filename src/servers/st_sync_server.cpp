@@ -1,4 +1,6 @@
 #include "sync_calculator/responser.hpp"
+#include "sync_calculator/service_arguments.hpp"
+#include "utils/metrics.hpp"
 #include "utils/server.hpp"
 
 #include <cerrno>
@@ -7,35 +9,44 @@
 #include <chrono>
 #include <filesystem>
 
-void server(std::string_view server_ip, uint16_t server_port,
-            int backlog_size) {
-  Server s{server_ip, server_port};
+template <typename Codec>
+void server(const Endpoint &endpoint, int backlog_size,
+            const SocketOptions &socket_options,
+            std::chrono::milliseconds tcp_info_interval) {
+  using Responser = BasicResponser<Codec>;
+  Server s{endpoint, socket_options};
   s.bind().listen(backlog_size);
-  {
-    int reuseaddr = 1;
-    CHECK(setsockopt(s.handle(), SOL_SOCKET, SO_REUSEADDR, &reuseaddr,
-                     sizeof(reuseaddr)));
-  }
-  {
-    int reuseport = 1;
-    CHECK(setsockopt(s.handle(), SOL_SOCKET, SO_REUSEPORT, &reuseport,
-                     sizeof(reuseport)));
-  }
 
+  const auto &metrics = get_server_metrics();
   while (true) {
     try {
       Session sess = s.accept();
+      metrics.connections_accepted.add();
+      metrics.connections.add(1);
       // handle connection
       try {
         Responser resp{sess.handle()};
+        auto next_tcp_info =
+            std::chrono::steady_clock::now() + tcp_info_interval;
         while (true) {
           // read from client
           resp.do_read();
           resp.do_write();
+          metrics.pending_responses.set(resp.pending_responses());
+          // only between requests, a blocking server has no idle wake ups
+          if (tcp_info_interval.count() &&
+              std::chrono::steady_clock::now() >= next_tcp_info) {
+            sample_tcp_info(sess);
+            next_tcp_info =
+                std::chrono::steady_clock::now() + tcp_info_interval;
+          }
         }
       } catch (const std::runtime_error &err) {
         ERROR(err.what());
         close(sess.handle());
+        metrics.connections_closed.add();
+        metrics.connections.add(-1);
+        metrics.pending_responses.set(0);
       }
     } catch (const std::runtime_error &err) {
       ERROR(err.what());
@@ -47,14 +58,10 @@ namespace fs = std::filesystem;
 
 int main(int argc, char **argv) {
   argparse::ArgumentParser parser(fs::path(argv[0]).filename());
-  parser.add_argument("--server-ip", "-s")
-      .default_value<std::string>("127.0.0.1");
-  parser.add_argument("--server-port", "-p")
-      .default_value<uint16_t>(7814)
-      .scan<'i', uint16_t>();
-  parser.add_argument("--backlog-size", "-b")
-      .default_value<int>(1)
-      .scan<'i', int>();
+  add_service_arguments(parser);
+  parser.add_argument("--transport")
+      .default_value<std::string>("socket")
+      .help("only socket, shm needs an event loop (st_select_server)");
 
   try {
     parser.parse_args(argc, argv);
@@ -64,12 +71,23 @@ int main(int argc, char **argv) {
   }
 
   try {
-    std::string server_ip = parser.get<std::string>("--server-ip");
-    uint16_t server_port = parser.get<uint16_t>("--server-port");
-    server(server_ip, server_port, parser.get<int>("--backlog-size"));
+    service_context context = apply_service_arguments(parser);
+    if (std::string transport = parser.get<std::string>("--transport");
+        transport != "socket") {
+      THROW("unsupported transport: {}, a blocking server only serves "
+            "sockets",
+            transport);
+    }
+    with_codec(parser.get<std::string>("--protocol"), [&](auto codec) {
+      server<decltype(codec)>(
+          context.endpoint, parser.get<int>("--backlog-size"),
+          context.socket_options,
+          std::chrono::milliseconds(
+              parser.get<size_t>("--tcp-info-interval")));
+    });
   } catch (const std::exception &e) {
     ERROR(e.what());
     exit(-1);
   }
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,124 @@
+#include "batch_evaluator.hpp"
+
+#include <immintrin.h>
+
+namespace {
+
+// at most 9 digits, so that an operand always fits into int32_t, longer
+// operands are left to the parser (which reports the overflow)
+constexpr size_t max_operand_digits = 9;
+
+bool parse_operand(std::string_view &data, int32_t &value) {
+  size_t i = 0;
+  int32_t res = 0;
+  while (i < data.size() && data[i] >= '0' && data[i] <= '9') {
+    if (i == max_operand_digits) {
+      return false;
+    }
+    res = res * 10 + (data[i] - '0');
+    i++;
+  }
+  if (i == 0) {
+    return false;
+  }
+  data.remove_prefix(i);
+  value = res;
+  return true;
+}
+
+inline int32_t evaluate_lane(int32_t a, int32_t b, int32_t mask) {
+  // multiply as unsigned, signed overflow is undefined behaviour
+  int32_t product = static_cast<int32_t>(static_cast<uint32_t>(a) *
+                                         static_cast<uint32_t>(b));
+  int32_t sum =
+      static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+  return mask ? product : sum;
+}
+
+using kernel_t = void (*)(const int32_t *, const int32_t *, const int32_t *,
+                          int32_t *, size_t);
+
+void evaluate_scalar(const int32_t *a, const int32_t *b, const int32_t *mask,
+                     int32_t *out, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    out[i] = evaluate_lane(a[i], b[i], mask[i]);
+  }
+}
+
+__attribute__((target("avx2"))) void
+evaluate_avx2(const int32_t *a, const int32_t *b, const int32_t *mask,
+              int32_t *out, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+    __m256i vm =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(mask + i));
+    __m256i sum = _mm256_add_epi32(va, vb);
+    __m256i product = _mm256_mullo_epi32(va, vb);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                        _mm256_blendv_epi8(sum, product, vm));
+  }
+  evaluate_scalar(a + i, b + i, mask + i, out + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void
+evaluate_avx512(const int32_t *a, const int32_t *b, const int32_t *mask,
+                int32_t *out, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512i va = _mm512_loadu_si512(a + i);
+    __m512i vb = _mm512_loadu_si512(b + i);
+    __mmask16 vm =
+        _mm512_test_epi32_mask(_mm512_loadu_si512(mask + i),
+                               _mm512_set1_epi32(-1));
+    __m512i sum = _mm512_add_epi32(va, vb);
+    __m512i product = _mm512_mullo_epi32(va, vb);
+    _mm512_storeu_si512(out + i, _mm512_mask_blend_epi32(vm, sum, product));
+  }
+  evaluate_scalar(a + i, b + i, mask + i, out + i, n - i);
+}
+
+kernel_t select_kernel() {
+  if (__builtin_cpu_supports("avx512f")) {
+    DEBUG("batch evaluator uses avx512f");
+    return evaluate_avx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    DEBUG("batch evaluator uses avx2");
+    return evaluate_avx2;
+  }
+  DEBUG("batch evaluator uses scalar fallback");
+  return evaluate_scalar;
+}
+
+} // namespace
+
+bool BatchEvaluator::push(std::string_view frame) {
+  int32_t a, b;
+  if (!parse_operand(frame, a) || frame.empty()) {
+    return false;
+  }
+  char op = frame.front();
+  if (op != '+' && op != '*') {
+    return false;
+  }
+  frame.remove_prefix(1);
+  if (!parse_operand(frame, b) || !frame.empty()) {
+    return false;
+  }
+  lhs.push_back(a);
+  rhs.push_back(b);
+  mul_mask.push_back(op == '*' ? -1 : 0);
+  return true;
+}
+
+const std::vector<int32_t> &BatchEvaluator::flush() {
+  static kernel_t kernel = select_kernel();
+  values.resize(lhs.size());
+  kernel(lhs.data(), rhs.data(), mul_mask.data(), values.data(), lhs.size());
+  lhs.clear();
+  rhs.clear();
+  mul_mask.clear();
+  return values;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "utils/common.hpp"
+
+#include <vector>
+
+// Most requests are `a+b` or `a*b` on plain integers (see
+// Requester::do_request). When a single read yields many of them we gather
+// the operands into SoA lanes and evaluate the whole batch with AVX2 /
+// AVX-512 in one pass, anything else still goes through the parser.
+class BatchEvaluator {
+public:
+  BatchEvaluator() = default;
+
+  // return false if `frame` is not a simple expression, in that case the
+  // caller has to flush() first and evaluate the frame with the parser, so
+  // that the order of results is preserved
+  bool push(std::string_view frame);
+  // evaluate all pending lanes, results are returned in push order and stay
+  // valid until the next flush()
+  const std::vector<int32_t> &flush();
+  size_t size() const { return lhs.size(); }
+  bool empty() const { return lhs.empty(); }
+
+private:
+  std::vector<int32_t> lhs{};
+  std::vector<int32_t> rhs{};
+  // all bits set for `*`, zero for `+`
+  std::vector<int32_t> mul_mask{};
+  std::vector<int32_t> values{};
+};
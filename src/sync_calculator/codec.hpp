@@ -0,0 +1,263 @@
+#pragma once
+
+#include "utils/common.hpp"
+#include "utils/exceptions.hpp"
+
+#include <optional>
+
+// the expression points into memory owned by the sender (see Workload), the
+// response is only verified if the expected value is known
+struct RequestData {
+  std::string_view expression{};
+  std::optional<int> expected{};
+};
+
+struct ResponseData {
+  int value{};
+  // requests rejected by the evaluation limits are answered with an error
+  // frame instead of closing the connection
+  std::optional<limit_error::limit_type> error{};
+};
+
+// Codec policies of Connection. Every frame starts with a 2 bytes header
+// holding the size of the body (see set_content_size), the codecs differ in
+// what goes into the body. Requests always carry the expression text, since
+// that is what the server parses; the decoded request message is the
+// expression as std::string_view.
+namespace codec {
+
+// a text response body starting with this marker is an error frame, followed
+// by the reason, e.g. `!depth` (see limit_error)
+constexpr char error_marker = '!';
+
+// format `message` as text into [out, out + available), return the size or
+// a value greater than `available` if it does not fit
+inline size_t format_text(char *out, size_t available,
+                          const RequestData &message) {
+  if (message.expression.size() <= available) {
+    memcpy(out, message.expression.data(), message.expression.size());
+  }
+  return message.expression.size();
+}
+
+inline size_t format_text(char *out, size_t available,
+                          const ResponseData &message) {
+  if (message.error) {
+    return fmt::format_to_n(out, available, "{}{}", error_marker,
+                            limit_error::type_name(*message.error))
+        .size;
+  }
+  return fmt::format_to_n(out, available, "{}", message.value).size;
+}
+
+template <typename Message> Message parse_text(std::string_view body);
+
+template <> inline std::string_view parse_text(std::string_view body) {
+  return body;
+}
+
+template <> inline ResponseData parse_text(std::string_view body) {
+  if (!body.empty() && body.front() == error_marker) {
+    auto type = limit_error::type_from_name(body.substr(1));
+    if (!type) {
+      throw program_error("unknown error frame: {}", escaped(body));
+    }
+    return {0, type};
+  }
+  if (!body.empty() && body.front() == '-') {
+    return {-stoi(body.substr(1))};
+  }
+  return {stoi(body)};
+}
+
+// write a frame with the body produced by `fill(body, capacity) -> size`,
+// where capacity is bounded by `available` and the range of the header,
+// return the size of the frame or 0 if it does not fit
+template <typename F>
+size_t encode_frame(char *out, size_t available, F &&fill) {
+  if (available <= header_size) {
+    return 0;
+  }
+  size_t capacity = std::min<size_t>(available - header_size, UINT16_MAX);
+  size_t body_size = fill(out + header_size, capacity);
+  if (body_size > capacity) {
+    return 0;
+  }
+  set_content_size(out, {static_cast<uint16_t>(body_size)});
+  return header_size + body_size;
+}
+
+// invoke `on_frame(body)` for every complete frame of `data`, return the
+// number of bytes consumed
+template <typename F> size_t decode_frames(std::string_view data, F &&on_frame) {
+  size_t consumed = 0;
+  while (data.size() - consumed >= header_size) {
+    size_t body_size = get_content_size(data.data() + consumed).size;
+    if (data.size() - consumed < header_size + body_size) {
+      // not fully read, wait for next read
+      break;
+    }
+    on_frame(data.substr(consumed + header_size, body_size));
+    consumed += header_size + body_size;
+  }
+  return consumed;
+}
+
+} // namespace codec
+
+// v1: one message per frame, decimal text
+struct TextCodec {
+  static constexpr std::string_view name = "text";
+
+  template <typename Queue>
+  static size_t encode(char *out, size_t available, Queue &messages) {
+    size_t written = 0;
+    while (!messages.empty()) {
+      size_t frame_size = codec::encode_frame(
+          out + written, available - written, [&](char *body, size_t n) {
+            return codec::format_text(body, n, messages.front());
+          });
+      if (frame_size == 0) {
+        // 留着下次再写吧
+        break;
+      }
+      messages.pop();
+      written += frame_size;
+    }
+    return written;
+  }
+
+  template <typename Message, typename F>
+  static size_t decode(std::string_view data, F &&on_message) {
+    return codec::decode_frames(data, [&](std::string_view body) {
+      on_message(codec::parse_text<Message>(body));
+    });
+  }
+};
+
+// v2: one message per frame, responses are a status byte (0 or 1 + the
+// limit_error::limit_type) followed by the value as big endian int32
+struct BinaryCodec {
+  static constexpr std::string_view name = "binary";
+  static constexpr size_t response_size = 1 + sizeof(int32_t);
+
+  template <typename Queue>
+  static size_t encode(char *out, size_t available, Queue &messages) {
+    size_t written = 0;
+    while (!messages.empty()) {
+      size_t frame_size = codec::encode_frame(
+          out + written, available - written, [&](char *body, size_t n) {
+            return format(body, n, messages.front());
+          });
+      if (frame_size == 0) {
+        break;
+      }
+      messages.pop();
+      written += frame_size;
+    }
+    return written;
+  }
+
+  template <typename Message, typename F>
+  static size_t decode(std::string_view data, F &&on_message) {
+    return codec::decode_frames(data, [&](std::string_view body) {
+      on_message(parse<Message>(body));
+    });
+  }
+
+private:
+  static size_t format(char *out, size_t available,
+                       const RequestData &message) {
+    return codec::format_text(out, available, message);
+  }
+
+  static size_t format(char *out, size_t available,
+                       const ResponseData &message) {
+    if (available < response_size) {
+      return response_size;
+    }
+    out[0] = message.error ? static_cast<char>(1 + *message.error) : 0;
+    uint32_t value = htonl(static_cast<uint32_t>(message.value));
+    memcpy(out + 1, &value, sizeof(value));
+    return response_size;
+  }
+
+  template <typename Message> static Message parse(std::string_view body) {
+    if constexpr (std::is_same_v<Message, ResponseData>) {
+      if (body.size() != response_size) {
+        throw program_error("invalid binary response: {}", octet_stream(body));
+      }
+      if (uint8_t status = body[0]; status != 0) {
+        // the status byte comes off the wire, only known types are valid
+        if (status - 1 > limit_error::steps) {
+          throw program_error("invalid binary response: {}",
+                              octet_stream(body));
+        }
+        return {0, static_cast<limit_error::limit_type>(status - 1)};
+      }
+      uint32_t value;
+      memcpy(&value, body.data() + 1, sizeof(value));
+      return {static_cast<int>(ntohl(value))};
+    } else {
+      return codec::parse_text<Message>(body);
+    }
+  }
+};
+
+// as many text messages as fit into one frame, separated by '\n', which
+// saves a header and a message boundary check per message
+struct BatchCodec {
+  static constexpr std::string_view name = "batch";
+  static constexpr char separator = '\n';
+
+  template <typename Queue>
+  static size_t encode(char *out, size_t available, Queue &messages) {
+    return codec::encode_frame(out, available, [&](char *body, size_t n) {
+      size_t size = 0;
+      while (!messages.empty()) {
+        size_t offset = size == 0 ? 0 : 1;
+        size_t message_size = codec::format_text(
+            body + size + offset, n - std::min(n, size + offset),
+            messages.front());
+        if (size + offset + message_size > n) {
+          break;
+        }
+        if (offset) {
+          body[size] = separator;
+        }
+        size += offset + message_size;
+        messages.pop();
+      }
+      // nothing fits, report the frame as too large
+      return size == 0 ? n + 1 : size;
+    });
+  }
+
+  template <typename Message, typename F>
+  static size_t decode(std::string_view data, F &&on_message) {
+    return codec::decode_frames(data, [&](std::string_view body) {
+      while (true) {
+        size_t end = body.find(separator);
+        on_message(codec::parse_text<Message>(body.substr(0, end)));
+        if (end == std::string_view::npos) {
+          break;
+        }
+        body.remove_prefix(end + 1);
+      }
+    });
+  }
+};
+
+// invoke `f(Codec{})` with the codec called `name`, used to pick the
+// instantiation from the command line
+template <typename F> void with_codec(std::string_view name, F &&f) {
+  if (name == TextCodec::name) {
+    f(TextCodec{});
+  } else if (name == BinaryCodec::name) {
+    f(BinaryCodec{});
+  } else if (name == BatchCodec::name) {
+    f(BatchCodec{});
+  } else {
+    THROW("unknown protocol: {}", name);
+  }
+}
@@ -0,0 +1,267 @@
+#include "evaluator.hpp"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ANTLRErrorStrategy.h"
+#include "BailErrorStrategy.h"
+#include "CalculatorLexer.h"
+#include "CalculatorParser.h"
+#include "antlr4-runtime.h"
+#include "utils/common.hpp"
+#include "utils/metrics.hpp"
+#include "utils/thread_pool.hpp"
+
+static evaluation_limits limits{};
+static evaluation_counters counters{};
+
+static size_t parallel_threshold = 0;
+static size_t parallel_threads = 0;
+static std::unique_ptr<ThreadPool> pool{};
+
+std::ostream &operator<<(std::ostream &os, const evaluation_limits &limits) {
+  return os << fmt::format("max depth: {}, max tokens: {}, max steps: {}",
+                           limits.max_depth, limits.max_tokens,
+                           limits.max_steps);
+}
+
+std::ostream &operator<<(std::ostream &os,
+                         const evaluation_counters &counters) {
+  return os << fmt::format(
+             "rejected (depth: {}, tokens: {}, steps: {}), "
+             "peak (depth: {}, tokens: {}, steps: {})",
+             counters.depth_rejected, counters.tokens_rejected,
+             counters.steps_rejected, counters.peak_depth,
+             counters.peak_tokens, counters.peak_steps);
+}
+
+// `counters` in the metrics registry, like them only updated by the thread
+// calling evaluate(), so the gauges hold the process wide peaks
+struct evaluation_metrics {
+  // indexed by limit_error::limit_type
+  std::array<Counter, 3> rejections;
+  Gauge peak_depth;
+  Gauge peak_tokens;
+  Gauge peak_steps;
+};
+
+static const evaluation_metrics &get_evaluation_metrics() {
+  static const evaluation_metrics metrics = [] {
+    auto &registry = MetricsRegistry::instance();
+    auto rejections = [&](limit_error::limit_type type) {
+      return registry.counter(
+          "calculator_limit_rejections_total",
+          "Expressions rejected by the evaluation limits.",
+          fmt::format("type=\"{}\"", limit_error::type_name(type)));
+    };
+    return evaluation_metrics{
+        {rejections(limit_error::depth), rejections(limit_error::tokens),
+         rejections(limit_error::steps)},
+        registry.gauge("calculator_peak_depth",
+                       "Largest nesting depth of an accepted expression."),
+        registry.gauge("calculator_peak_tokens",
+                       "Most tokens of an accepted expression."),
+        registry.gauge("calculator_peak_steps",
+                       "Most evaluation steps of an accepted expression."),
+    };
+  }();
+  return metrics;
+}
+
+void set_evaluation_limits(const evaluation_limits &_limits) {
+  limits = _limits;
+  INFO("evaluation limits: {}", limits);
+  // registered up front, so that they are scraped before the first rejection
+  get_evaluation_metrics();
+}
+
+const evaluation_counters &get_evaluation_counters() { return counters; }
+
+void set_parallel_evaluation(size_t threshold, size_t n_threads) {
+  if (n_threads == 0) {
+    n_threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  parallel_threshold = threshold;
+  if (parallel_threads != n_threads) {
+    // the pool is created lazily by the first large expression
+    pool.reset();
+    parallel_threads = n_threads;
+  }
+  INFO("parallel evaluation threshold: {} bytes, threads: {}",
+       parallel_threshold, parallel_threads);
+}
+
+static void count_rejection(const limit_error &err) {
+  size_t *rejected = nullptr;
+  switch (err.type()) {
+  case limit_error::depth:
+    rejected = &counters.depth_rejected;
+    break;
+  case limit_error::tokens:
+    rejected = &counters.tokens_rejected;
+    break;
+  case limit_error::steps:
+    rejected = &counters.steps_rejected;
+    break;
+  }
+  (*rejected)++;
+  get_evaluation_metrics().rejections[err.type()].add();
+  size_t total = counters.depth_rejected + counters.tokens_rejected +
+                 counters.steps_rejected;
+  // log only every power of two rejections, so that a flood of pathological
+  // frames does not turn into a flood of log lines
+  if ((total & (total - 1)) == 0) {
+    INFO("reject expression: {}, {}", err.what(), counters);
+  }
+}
+
+namespace {
+
+struct evaluation_result {
+  int value{};
+  size_t depth{};
+  size_t tokens{};
+  size_t steps{};
+};
+
+// the generated lexer and parser are not thread safe, every thread of the
+// pool gets its own instance
+evaluation_result evaluate_sequential(std::string_view expression) {
+  static thread_local parser::CalculatorLexer lexer(nullptr);
+  static thread_local parser::CalculatorParser parser(nullptr);
+  static thread_local auto error_handler =
+      std::make_shared<antlr4::BailErrorStrategy>();
+  try {
+    antlr4::ANTLRInputStream inputs(expression);
+    lexer._input = &inputs;
+    lexer.reset();
+    lexer.max_tokens = limits.max_tokens;
+    lexer.token_count = 0;
+    antlr4::CommonTokenStream tokens(&lexer);
+    parser.setTokenStream(&tokens);
+    parser.setBuildParseTree(false);
+    parser.setErrorHandler(error_handler);
+    parser.max_depth = limits.max_depth;
+    parser.max_steps = limits.max_steps;
+    parser.depth = 0;
+    parser.peak_depth = 0;
+    parser.step_count = 0;
+    parser.s();
+    return {parser.expression_value, parser.peak_depth, lexer.token_count,
+            parser.step_count};
+  } catch (const limit_error &) {
+    throw;
+  } catch (const std::exception &err) {
+    // TODO: make here throw with nested exception
+    throw parse_error(err.what());
+  }
+}
+
+// split `expression` at top-level `+` into at most `n_parts` parts of roughly
+// equal size, return nothing if it can not be split (e.g. a single product or
+// unbalanced parentheses, the parser reports the latter)
+std::vector<std::string_view> split_terms(std::string_view expression,
+                                          size_t n_parts) {
+  std::vector<std::string_view> parts;
+  size_t part_size = expression.size() / n_parts + 1;
+  size_t begin = 0;
+  int depth = 0;
+  for (size_t i = 0; i < expression.size(); i++) {
+    char ch = expression[i];
+    if (ch == '(') {
+      depth++;
+    } else if (ch == ')') {
+      if (--depth < 0) {
+        return {};
+      }
+    } else if (ch == '+' && depth == 0 && i - begin >= part_size) {
+      parts.emplace_back(expression.substr(begin, i - begin));
+      begin = i + 1;
+    }
+  }
+  if (depth != 0 || parts.empty()) {
+    return {};
+  }
+  parts.emplace_back(expression.substr(begin));
+  return parts;
+}
+
+evaluation_result evaluate_parallel(std::string_view expression) {
+  if (!pool) {
+    pool = std::make_unique<ThreadPool>(parallel_threads);
+  }
+  // a few parts per thread to even out products of different cost
+  auto parts = split_terms(expression, pool->size() * 4);
+  if (parts.empty()) {
+    return evaluate_sequential(expression);
+  }
+  std::vector<std::future<evaluation_result>> futures;
+  futures.reserve(parts.size());
+  for (auto part : parts) {
+    futures.emplace_back(
+        pool->submit([part]() { return evaluate_sequential(part); }));
+  }
+  // `+` is associative, so the parts can be reduced in any grouping, but we
+  // must wait for all of them before rethrowing, they still refer to
+  // `expression`
+  evaluation_result result{};
+  std::exception_ptr error{};
+  for (auto &f : futures) {
+    try {
+      auto part = f.get();
+      result.value = static_cast<int>(static_cast<unsigned>(result.value) +
+                                      static_cast<unsigned>(part.value));
+      result.depth = std::max(result.depth, part.depth);
+      // each part ends with EOF instead of the `+` that separated it
+      result.tokens += part.tokens;
+      result.steps += part.steps;
+    } catch (...) {
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  result.steps += parts.size() - 1;
+  // every part was checked against the whole budget, check the sum as well
+  if (result.tokens > limits.max_tokens && limits.max_tokens != 0) {
+    throw limit_error(limit_error::tokens, "token count exceeds {}",
+                      limits.max_tokens);
+  }
+  if (result.steps > limits.max_steps && limits.max_steps != 0) {
+    throw limit_error(limit_error::steps, "evaluation steps exceed {}",
+                      limits.max_steps);
+  }
+  return result;
+}
+
+} // namespace
+
+int evaluate(std::string_view expression) {
+  try {
+    evaluation_result result =
+        parallel_threshold != 0 && expression.size() >= parallel_threshold
+            ? evaluate_parallel(expression)
+            : evaluate_sequential(expression);
+    const auto &metrics = get_evaluation_metrics();
+    if (result.depth > counters.peak_depth) {
+      counters.peak_depth = result.depth;
+      metrics.peak_depth.set(result.depth);
+    }
+    if (result.tokens > counters.peak_tokens) {
+      counters.peak_tokens = result.tokens;
+      metrics.peak_tokens.set(result.tokens);
+    }
+    if (result.steps > counters.peak_steps) {
+      counters.peak_steps = result.steps;
+      metrics.peak_steps.set(result.steps);
+    }
+    return result.value;
+  } catch (const limit_error &err) {
+    count_rejection(err);
+    throw;
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string_view>
+
+#include "utils/common.hpp"
+
+// complexity limits enforced while parsing, a single pathological frame must
+// not stall every other connection on the event loop (or overflow the stack
+// of the recursive parser), 0 means unlimited
+struct evaluation_limits {
+  size_t max_depth{};
+  size_t max_tokens{};
+  size_t max_steps{};
+};
+
+struct evaluation_counters {
+  size_t depth_rejected{};
+  size_t tokens_rejected{};
+  size_t steps_rejected{};
+  // largest values seen in accepted expressions, used to tune the limits
+  size_t peak_depth{};
+  size_t peak_tokens{};
+  size_t peak_steps{};
+};
+
+std::ostream &operator<<(std::ostream &os, const evaluation_limits &limits);
+std::ostream &operator<<(std::ostream &os,
+                         const evaluation_counters &counters);
+
+template <> struct fmt::formatter<evaluation_limits> : ostream_formatter {};
+template <> struct fmt::formatter<evaluation_counters> : ostream_formatter {};
+
+void set_evaluation_limits(const evaluation_limits &limits);
+const evaluation_counters &get_evaluation_counters();
+
+// expressions of at least `threshold` bytes are split at top-level `+` and the
+// parts are reduced in parallel on a pool of `n_threads` threads (0 means
+// std::thread::hardware_concurrency()), a threshold of 0 disables it (the
+// default). The servers leave it disabled: their frames are bounded by the
+// 1 KiB receive buffer and the default token limit, far below any threshold
+// worth a thread hop, so this is for callers evaluating large expressions
+// directly (see bench_parallel_evaluation).
+void set_parallel_evaluation(size_t threshold, size_t n_threads);
+
+// evaluate `expression` with the antlr4 generated parser, throw limit_error
+// if the expression exceeds the evaluation limits and parse_error if the
+// expression is not accepted by Calculator.g4
+int evaluate(std::string_view expression);
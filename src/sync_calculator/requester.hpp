@@ -1,36 +1,66 @@
 #pragma once
 
+#include "codec.hpp"
+#include "utils/buffer.hpp"
 #include "utils/common.hpp"
+#include "utils/connection.hpp"
+#include "utils/histogram.hpp"
 
+#include <chrono>
+#include <deque>
 #include <queue>
 
-class Requester {
+template <typename Codec = TextCodec, typename Buffer = FixedBuffer<1024>,
+          typename Stream = SocketStream>
+class BasicRequester {
 public:
-  Requester() = default;
-  Requester(int sock_fd) : sock_fd(sock_fd) {}
+  using clock = std::chrono::steady_clock;
 
-  struct RequestData {
-    int a{};
-    int b{};
-  };
+  BasicRequester() = default;
+  // the latency of every response (from the request being written to the
+  // response being matched, in ns) is recorded into `latency` if given
+  BasicRequester(Stream stream, Histogram *latency = nullptr)
+      : connection(std::move(stream)), latency(latency) {}
 
   void do_write();
-  void do_request();
+  // queue `request_data` (e.g. drawn from a WorkloadStream), it must stay
+  // valid until its response was read. an open loop load generator passes
+  // the time the request was scheduled for, latency is then measured from it
+  // instead of the actual write, so that a stalled server can not hide its
+  // queueing delay (coordinated omission)
+  void do_request(const RequestData &request_data,
+                  clock::time_point intended_time = {});
   void do_read();
-  int handle() const { return sock_fd; }
+  int handle() const { return connection.handle(); }
   bool has_requests() const { return !wait_queue.empty(); }
+  bool has_unsent() const {
+    return !requests.empty() || connection.has_pending_writes();
+  }
   int n_requests() const { return wait_queue.size(); }
+  int n_rejected() const { return n_rejected_requests; }
 
 private:
-  int sock_fd{};
-  std::array<char, 1024> send_buffer{};
-  std::array<char, 1024> recv_buffer{};
+  struct PendingRequest {
+    RequestData data{};
+    clock::time_point send_time{};
+  };
+
+  Connection<Codec, Buffer, Stream> connection{};
+  Histogram *latency = nullptr;
   // 待发送的所有请求 ？
   std::queue<RequestData> requests{};
-  // 等待服务器返回计算结果的 queue
-  std::queue<RequestData> wait_queue{};
-  size_t recv_buffer_bytes_written = 0;
-  size_t recv_buffer_bytes_available = recv_buffer.size();
-  size_t send_buffer_bytes_written = 0;
-  size_t send_buffer_bytes_available = send_buffer.size();
-};
\ No newline at end of file
+  // 等待服务器返回计算结果的 queue, the last requests.size() entries are not
+  // written yet
+  std::deque<PendingRequest> wait_queue{};
+  int n_rejected_requests = 0;
+};
+
+using Requester = BasicRequester<>;
+
+extern template class BasicRequester<TextCodec>;
+extern template class BasicRequester<BinaryCodec>;
+extern template class BasicRequester<BatchCodec>;
+extern template class BasicRequester<TextCodec, FixedBuffer<1024>, ShmChannel>;
+extern template class BasicRequester<BinaryCodec, FixedBuffer<1024>,
+                                     ShmChannel>;
+extern template class BasicRequester<BatchCodec, FixedBuffer<1024>, ShmChannel>;
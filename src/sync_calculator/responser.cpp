@@ -1,116 +1,139 @@
 #include "responser.hpp"
+#include "evaluator.hpp"
+#include "utils/common.hpp"
+#include "utils/trace.hpp"
 
-#include <cerrno>
-#include <memory>
-#include <unistd.h>
+static ResultCache *cache = nullptr;
 
-#include <spdlog/fmt/bundled/ranges.h>
+void set_result_cache(ResultCache *_cache) { cache = _cache; }
 
-#include "ANTLRErrorStrategy.h"
-#include "BailErrorStrategy.h"
-#include "CalculatorLexer.h"
-#include "CalculatorParser.h"
-#include "antlr4-runtime.h"
-#include "utils/common.hpp"
+const server_metrics &get_server_metrics() {
+  static const server_metrics metrics = [] {
+    auto &registry = MetricsRegistry::instance();
+    return server_metrics{
+        registry.counter("calculator_connections_accepted_total",
+                         "Connections accepted."),
+        registry.counter("calculator_connections_closed_total",
+                         "Connections closed."),
+        registry.counter("calculator_requests_received_total",
+                         "Requests received, a batch frame holds several."),
+        registry.counter("calculator_responses_sent_total",
+                         "Responses sent, a batch frame holds several."),
+        registry.counter("calculator_received_bytes_total", "Bytes received."),
+        registry.counter("calculator_sent_bytes_total", "Bytes sent."),
+        registry.counter("calculator_parse_errors_total",
+                         "Requests rejected by the parser."),
+        registry.gauge("calculator_connections", "Open connections."),
+        registry.gauge("calculator_pending_responses",
+                       "Responses waiting for the socket."),
+        registry.gauge("calculator_ready_fds",
+                       "File descriptors ready in the last loop iteration."),
+        registry.histogram("calculator_loop_iteration_seconds",
+                           "Time spent handling one loop iteration."),
+        registry.histogram("calculator_tcp_rtt_seconds",
+                           "Smoothed round trip time of the connections."),
+        registry.histogram("calculator_tcp_rttvar_seconds",
+                           "Round trip time variation of the connections."),
+        registry.value_histogram(
+            "calculator_tcp_retransmits",
+            "Segments retransmitted over the lifetime of the connections."),
+        registry.value_histogram("calculator_tcp_unacked",
+                                 "Segments not acknowledged yet."),
+        registry.value_histogram("calculator_tcp_send_queue_bytes",
+                                 "Bytes not sent or not acknowledged yet."),
+    };
+  }();
+  return metrics;
+}
 
-void Responser::do_write() {
-  if (responses.empty()) {
+void sample_tcp_info(const Session &session) {
+  // no TCP_INFO for unix sockets
+  if (!session.local_endpoint().is_inet()) {
     return;
   }
-  char *data_ptr = send_buffer.data() + send_buffer_bytes_written;
-  while (send_buffer_bytes_available > 0 && !responses.empty()) {
-    auto response = responses.front();
-    std::string response_body = fmt::format("{}", response);
-    size_t packet_size = header_size + response_body.size();
-    if (packet_size > send_buffer_bytes_available) {
-      break;
-    }
-    responses.pop();
-    memcpy(data_ptr + header_size, response_body.data(), response_body.size());
-    set_content_size(data_ptr, {static_cast<uint16_t>(response_body.size())});
-    data_ptr += packet_size;
-    send_buffer_bytes_available -= packet_size;
-    send_buffer_bytes_written += packet_size;
-  }
-  ssize_t bytes_written =
-      write(sock_fd, send_buffer.data(), send_buffer_bytes_written);
-  if (bytes_written == -1) {
-    // ignore
-    int _errno = errno;
-    if (would_block(errno)) {
-      return;
-    }
-    throw send_error(get_errno_string(_errno));
+  const auto &metrics = get_server_metrics();
+  try {
+    tcp_info_sample sample = session.tcp_info();
+    metrics.tcp_rtt.record(uint64_t{sample.rtt_us} * 1000);
+    metrics.tcp_rttvar.record(uint64_t{sample.rttvar_us} * 1000);
+    metrics.tcp_retransmits.record(sample.retransmits);
+    metrics.tcp_unacked.record(sample.unacked);
+    metrics.tcp_send_queue_bytes.record(sample.send_queue_bytes);
+    DEBUG("{}, {}", session, sample);
+  } catch (const program_error &err) {
+    DEBUG("can not sample {}: {}", session.remote_endpoint(), err.what());
   }
-  DEBUG("send: {}",
-        escaped(std::string_view(send_buffer.data(), bytes_written)));
-  // 最后调整数据？感觉这里实现一个 ring buffer 会不会好一点？
-  // TODO: use ring buffer to make here more efficient ?
-  std::copy(send_buffer.data() + bytes_written,
-            send_buffer.data() + send_buffer_bytes_written, send_buffer.data());
-  send_buffer_bytes_available += bytes_written;
-  send_buffer_bytes_written -= bytes_written;
 }
 
-void Responser::do_response(std::string_view request_data) {
-  static parser::CalculatorLexer lexer(nullptr);
-  static parser::CalculatorParser parser(nullptr);
-  static auto error_handler = std::make_shared<antlr4::BailErrorStrategy>();
+template <typename Codec, typename Buffer, typename Stream>
+void BasicResponser<Codec, Buffer, Stream>::do_response(
+    std::string_view request_data) {
+  TRACE_SCOPE("do_response");
+  // requests the batch evaluator did not take, i.e. parsed ones
+  TIMER_BEGIN("do_response")
   try {
-    antlr4::ANTLRInputStream inputs(request_data);
-    lexer._input = &inputs;
-    lexer.reset();
-    antlr4::CommonTokenStream tokens(&lexer);
-    parser.setTokenStream(&tokens);
-    parser.setBuildParseTree(false);
-    parser.setErrorHandler(error_handler);
-    parser.s();
-    responses.emplace(parser.expression_value);
-  } catch (const std::exception &err) {
-    // TODO: make here throw with nested exception
-    throw parse_error(err.what());
+    // simple frames never get here (see BatchEvaluator), they are cheaper to
+    // evaluate than to look up
+    if (cache) {
+      if (auto value = cache->find(request_data)) {
+        responses.push({*value});
+        return;
+      }
+    }
+    int value = evaluate(request_data);
+    if (cache) {
+      cache->insert(request_data, value);
+    }
+    responses.push({value});
+  } catch (const limit_error &err) {
+    responses.push({0, err.type()});
+  } catch (const parse_error &) {
+    get_server_metrics().parse_errors.add();
+    throw;
   }
+  TIMER_END()
 }
 
-void Responser::do_read() {
-  int bytes_received;
-  bytes_received = read(sock_fd, recv_buffer.data() + recv_buffer_bytes_written,
-                        recv_buffer_bytes_available);
-  if (bytes_received == 0) {
-    throw eof_error();
-  } else if (bytes_received == -1) {
-    int _errno = errno;
-    if (would_block(errno)) {
-      return;
-    }
-    throw recv_error(get_errno_string(errno));
+template <typename Codec, typename Buffer, typename Stream>
+void BasicResponser<Codec, Buffer, Stream>::flush_batch() {
+  TRACE_SCOPE("flush_batch");
+  for (int32_t value : batch.flush()) {
+    responses.push({value});
   }
-  DEBUG("recv: {}",
-        escaped(std::string_view(recv_buffer.data() + recv_buffer_bytes_written,
-                                 bytes_received)));
-  char *data_ptr = recv_buffer.data();
-  bytes_received += recv_buffer_bytes_written;
-  while (bytes_received > 0) {
-    if (bytes_received < header_size) {
-      std::copy(data_ptr, data_ptr + bytes_received, recv_buffer.data());
-      DEBUG("incomplete header, bytes_received: {}", bytes_received);
-      break;
-    }
-    // 此处有可能 bytes_received == 1，甚至都读不到实际的
-    // header，这种情况怎么办？ read packet
-    uint16_t data_size = get_content_size(data_ptr).size;
-    size_t packet_size = data_size + header_size;
-    if (packet_size > bytes_received) {
-      std::copy(data_ptr, data_ptr + bytes_received, recv_buffer.data());
-      // not fully read, wait for next read
-      DEBUG("incomplete body");
-      break;
-    }
-    std::string_view packet_data(data_ptr + header_size, data_size);
-    do_response(packet_data);
-    data_ptr += packet_size;
-    bytes_received -= packet_size;
-  }
-  recv_buffer_bytes_written = bytes_received;
-  recv_buffer_bytes_available = recv_buffer.size() - bytes_received;
-}
\ No newline at end of file
+}
+
+template <typename Codec, typename Buffer, typename Stream>
+void BasicResponser<Codec, Buffer, Stream>::do_read() {
+  TRACE_SCOPE("do_read");
+  const auto &metrics = get_server_metrics();
+  size_t n_requests = 0;
+  size_t bytes = connection.template read<std::string_view>(
+      [this, &n_requests](std::string_view request) {
+        n_requests++;
+        // simple `a+b` / `a*b` requests are evaluated together, flush them
+        // before falling back to the parser to keep responses in order
+        if (!batch.push(request)) {
+          flush_batch();
+          do_response(request);
+        }
+      });
+  flush_batch();
+  metrics.bytes_in.add(bytes);
+  metrics.requests_in.add(n_requests);
+}
+
+template <typename Codec, typename Buffer, typename Stream>
+void BasicResponser<Codec, Buffer, Stream>::do_write() {
+  TRACE_SCOPE("do_write");
+  const auto &metrics = get_server_metrics();
+  size_t n_responses = responses.size();
+  metrics.bytes_out.add(connection.write(responses));
+  metrics.responses_out.add(n_responses - responses.size());
+}
+
+template class BasicResponser<TextCodec>;
+template class BasicResponser<BinaryCodec>;
+template class BasicResponser<BatchCodec>;
+template class BasicResponser<TextCodec, FixedBuffer<1024>, ShmChannel>;
+template class BasicResponser<BinaryCodec, FixedBuffer<1024>, ShmChannel>;
+template class BasicResponser<BatchCodec, FixedBuffer<1024>, ShmChannel>;
@@ -1,27 +1,77 @@
 #pragma once
 
+#include "batch_evaluator.hpp"
+#include "codec.hpp"
+#include "result_cache.hpp"
+#include "utils/buffer.hpp"
 #include "utils/common.hpp"
+#include "utils/connection.hpp"
+#include "utils/metrics.hpp"
 
 #include <queue>
 
-class Responser {
+// shared by all responsers, nullptr disables the cache
+void set_result_cache(ResultCache *cache);
+
+// server side metrics, messages, bytes and parse errors are recorded by the
+// responsers, the rest by the event loops of the servers
+struct server_metrics {
+  Counter connections_accepted;
+  Counter connections_closed;
+  Counter requests_in;
+  Counter responses_out;
+  Counter bytes_in;
+  Counter bytes_out;
+  Counter parse_errors;
+  Gauge connections;
+  // responses evaluated but not accepted by the socket yet
+  Gauge pending_responses;
+  // fds reported ready by the last select / epoll_wait
+  Gauge ready_fds;
+  // time spent handling the ready fds of one loop iteration
+  TimeHistogram loop_iteration;
+  // distributions over the connections, see sample_tcp_info()
+  TimeHistogram tcp_rtt;
+  TimeHistogram tcp_rttvar;
+  ValueHistogram tcp_retransmits;
+  ValueHistogram tcp_unacked;
+  ValueHistogram tcp_send_queue_bytes;
+};
+
+const server_metrics &get_server_metrics();
+
+// record the tcp_info_sample of `session` into the server metrics and log the
+// session at debug level, called periodically for every connection, unix
+// socket sessions are skipped
+void sample_tcp_info(const Session &session);
+
+template <typename Codec = TextCodec, typename Buffer = FixedBuffer<1024>,
+          typename Stream = SocketStream>
+class BasicResponser {
 public:
-  Responser() = default;
-  Responser(int sock_fd) : sock_fd(sock_fd) {}
+  BasicResponser() = default;
+  BasicResponser(Stream stream) : connection(std::move(stream)) {}
 
-  void set_sock_fd(int _sock_fd) { sock_fd = _sock_fd; }
   void do_write();
   void do_response(std::string_view request_data);
   void do_read();
-  int handle() const { return sock_fd; }
+  int handle() const { return connection.handle(); }
+  size_t pending_responses() const { return responses.size(); }
 
 private:
-  int sock_fd{};
-  std::array<char, 1024> send_buffer{};
-  std::array<char, 1024> recv_buffer{};
-  std::queue<int> responses{};
-  size_t send_buffer_bytes_written = 0;
-  size_t send_buffer_bytes_available = send_buffer.size();
-  size_t recv_buffer_bytes_written = 0;
-  size_t recv_buffer_bytes_available = recv_buffer.size();
-};
\ No newline at end of file
+  void flush_batch();
+
+  Connection<Codec, Buffer, Stream> connection{};
+  std::queue<ResponseData> responses{};
+  BatchEvaluator batch{};
+};
+
+using Responser = BasicResponser<>;
+
+extern template class BasicResponser<TextCodec>;
+extern template class BasicResponser<BinaryCodec>;
+extern template class BasicResponser<BatchCodec>;
+extern template class BasicResponser<TextCodec, FixedBuffer<1024>, ShmChannel>;
+extern template class BasicResponser<BinaryCodec, FixedBuffer<1024>,
+                                     ShmChannel>;
+extern template class BasicResponser<BatchCodec, FixedBuffer<1024>, ShmChannel>;
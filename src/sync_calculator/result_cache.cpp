@@ -0,0 +1,195 @@
+#include "result_cache.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+ResultCache::ResultCache(const std::filesystem::path &path, size_t capacity,
+                         const evaluation_limits &limits) {
+  size_t n_slots = 1;
+  while (n_slots < capacity) {
+    n_slots <<= 1;
+  }
+  size_t arena_size = n_slots * arena_bytes_per_slot;
+  mapped_size = sizeof(file_header) + n_slots * sizeof(entry) + arena_size;
+
+  CHECK(fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644));
+  // the destructor does not run if the constructor throws
+  try {
+    struct stat file_stat {};
+    CHECK(::fstat(fd_, &file_stat));
+    bool valid = static_cast<size_t>(file_stat.st_size) == mapped_size;
+    if (valid) {
+      file_header existing{};
+      valid =
+          ::pread(fd_, &existing, sizeof(existing), 0) == sizeof(existing) &&
+          existing.magic == magic && existing.version == version &&
+          existing.capacity == n_slots && existing.arena_size == arena_size &&
+          existing.max_depth == limits.max_depth &&
+          existing.max_tokens == limits.max_tokens &&
+          existing.max_steps == limits.max_steps;
+    }
+    if (!valid) {
+      if (file_stat.st_size != 0) {
+        INFO("result cache {} is incompatible, reinitialize it",
+             path.string());
+      }
+      // zero filled, i.e. all slots are empty
+      CHECK(::ftruncate(fd_, 0));
+      CHECK(::ftruncate(fd_, mapped_size));
+    }
+
+    void *addr = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd_, 0);
+    if (addr == MAP_FAILED) {
+      int _errno = errno;
+      THROW("failed to map result cache {}: {}", path.string(),
+            get_errno_string(_errno));
+    }
+    mapped = static_cast<char *>(addr);
+    header = reinterpret_cast<file_header *>(mapped);
+    entries = reinterpret_cast<entry *>(mapped + sizeof(file_header));
+    arena = mapped + sizeof(file_header) + n_slots * sizeof(entry);
+    dirty_begin = mapped_size;
+    dirty_end = 0;
+
+    if (!valid) {
+      header->magic = magic;
+      header->version = version;
+      header->capacity = n_slots;
+      header->max_depth = limits.max_depth;
+      header->max_tokens = limits.max_tokens;
+      header->max_steps = limits.max_steps;
+      header->arena_size = arena_size;
+      header->size = 0;
+      header->arena_used = 0;
+      header_dirty = true;
+      sync(true);
+    }
+  } catch (...) {
+    if (mapped) {
+      ::munmap(mapped, mapped_size);
+    }
+    ::close(fd_);
+    throw;
+  }
+  INFO("load result cache {}, {} / {} entries", path.string(), header->size,
+       header->capacity);
+}
+
+ResultCache::~ResultCache() {
+  if (mapped) {
+    sync(true);
+    ::munmap(mapped, mapped_size);
+  }
+  if (fd_ != -1) {
+    ::close(fd_);
+  }
+}
+
+uint64_t ResultCache::hash(std::string_view expression) {
+  // FNV-1a, std::hash is not guaranteed to be stable across builds
+  uint64_t h = 14695981039346656037ULL;
+  for (char ch : expression) {
+    h ^= static_cast<uint8_t>(ch);
+    h *= 1099511628211ULL;
+  }
+  return h == 0 ? 1 : h;
+}
+
+bool ResultCache::matches(const entry &e, uint64_t h,
+                          std::string_view expression) const {
+  // the hash alone is easy to collide on purpose
+  return e.hash == h && e.length == expression.size() &&
+         e.offset + e.length <= header->arena_used &&
+         std::memcmp(arena + e.offset, expression.data(), e.length) == 0;
+}
+
+std::optional<int> ResultCache::find(std::string_view expression) const {
+  uint64_t h = hash(expression);
+  size_t mask = header->capacity - 1;
+  for (size_t i = 0; i < max_probes; i++) {
+    const entry &e = entries[(h + i) & mask];
+    if (e.hash == 0) {
+      break;
+    }
+    if (matches(e, h, expression)) {
+      return e.value;
+    }
+  }
+  return std::nullopt;
+}
+
+void ResultCache::insert(std::string_view expression, int value) {
+  if (expression.size() > header->arena_size) {
+    return;
+  }
+  if (header->arena_used + expression.size() > header->arena_size) {
+    clear();
+  }
+  uint64_t h = hash(expression);
+  size_t mask = header->capacity - 1;
+  entry *slot = &entries[h & mask];
+  for (size_t i = 0; i < max_probes; i++) {
+    entry &e = entries[(h + i) & mask];
+    if (e.hash == 0) {
+      header->size++;
+      slot = &e;
+      break;
+    }
+    if (matches(e, h, expression)) {
+      // already stored, only the value changes
+      e.value = value;
+      mark_dirty(&e, sizeof(entry));
+      return;
+    }
+  }
+  // the probe sequence is full, evict the home slot, its expression stays in
+  // the arena until the next clear()
+  char *key = arena + header->arena_used;
+  std::memcpy(key, expression.data(), expression.size());
+  mark_dirty(key, expression.size());
+  *slot = {h, header->arena_used, static_cast<uint32_t>(expression.size()),
+           value};
+  mark_dirty(slot, sizeof(entry));
+  header->arena_used += expression.size();
+  header_dirty = true;
+  if (++n_unsynced >= sync_interval) {
+    sync();
+  }
+}
+
+void ResultCache::clear() {
+  INFO("result cache arena is full, clear {} entries", header->size);
+  std::memset(entries, 0, header->capacity * sizeof(entry));
+  mark_dirty(entries, header->capacity * sizeof(entry));
+  header->size = 0;
+  header->arena_used = 0;
+  header_dirty = true;
+}
+
+void ResultCache::mark_dirty(const void *begin, size_t size) {
+  size_t offset = static_cast<const char *>(begin) - mapped;
+  dirty_begin = std::min(dirty_begin, offset);
+  dirty_end = std::max(dirty_end, offset + size);
+}
+
+void ResultCache::sync(bool wait) {
+  int flags = wait ? MS_SYNC : MS_ASYNC;
+  static const size_t page_size = ::sysconf(_SC_PAGESIZE);
+  // the header lives in the first page, keep it out of the dirty range of
+  // entries, which would otherwise always start at offset 0
+  if (header_dirty) {
+    CHECK(::msync(mapped, sizeof(file_header), flags));
+    header_dirty = false;
+  }
+  if (dirty_begin < dirty_end) {
+    size_t begin = dirty_begin / page_size * page_size;
+    CHECK(::msync(mapped + begin, dirty_end - begin, flags));
+  }
+  dirty_begin = mapped_size;
+  dirty_end = 0;
+  n_unsynced = 0;
+}
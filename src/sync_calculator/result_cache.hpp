@@ -0,0 +1,84 @@
+#pragma once
+
+#include "evaluator.hpp"
+#include "utils/common.hpp"
+
+#include <filesystem>
+#include <optional>
+
+// Persistent cache of expression -> result, an open-addressing table living
+// in a memory mapped file, so that it survives restarts of the servers.
+// Lookups are served directly from the mapped pages, dirty pages are written
+// back incrementally with msync. The expressions themselves are kept in an
+// append-only arena behind the table and compared on lookup, when the arena is
+// full the whole cache is cleared.
+class ResultCache {
+public:
+  // open `path`, the file is (re)initialized if it does not exist or was
+  // created with another version, capacity or `limits` (an expression cached
+  // under looser limits must not be answered under stricter ones), `capacity`
+  // is rounded up to a power of two
+  ResultCache(const std::filesystem::path &path, size_t capacity,
+              const evaluation_limits &limits = {});
+  ~ResultCache();
+
+  ResultCache(const ResultCache &) = delete;
+  ResultCache &operator=(const ResultCache &) = delete;
+
+  std::optional<int> find(std::string_view expression) const;
+  void insert(std::string_view expression, int value);
+  // write back dirty pages, asynchronously unless `wait` is set
+  void sync(bool wait = false);
+
+  size_t size() const { return header->size; }
+  size_t capacity() const { return header->capacity; }
+
+private:
+  static constexpr std::array<char, 8> magic{'C', 'A', 'L', 'C',
+                                             'C', 'A', 'C', 'H'};
+  static constexpr uint32_t version = 2;
+  // number of slots probed before the home slot is overwritten
+  static constexpr size_t max_probes = 16;
+  // insertions between two incremental write backs
+  static constexpr size_t sync_interval = 1024;
+  // arena bytes per slot, expressions average far less than this
+  static constexpr size_t arena_bytes_per_slot = 64;
+
+  struct file_header {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t capacity;
+    uint64_t max_depth;
+    uint64_t max_tokens;
+    uint64_t max_steps;
+    uint64_t arena_size;
+    uint64_t size;
+    uint64_t arena_used;
+  };
+
+  // hash 0 marks an empty slot, the expression is at `offset` of the arena
+  struct entry {
+    uint64_t hash;
+    uint64_t offset;
+    uint32_t length;
+    int32_t value;
+  };
+
+  static uint64_t hash(std::string_view expression);
+  bool matches(const entry &e, uint64_t h, std::string_view expression) const;
+  // drop every entry and the arena, once the arena is full
+  void clear();
+  void mark_dirty(const void *begin, size_t size);
+
+  int fd_{-1};
+  size_t mapped_size{};
+  char *mapped{};
+  file_header *header{};
+  entry *entries{};
+  char *arena{};
+  bool header_dirty{};
+  size_t dirty_begin{};
+  size_t dirty_end{};
+  size_t n_unsynced{};
+};
@@ -0,0 +1,125 @@
+#include "service_arguments.hpp"
+#include "evaluator.hpp"
+#include "responser.hpp"
+#include "utils/timer.hpp"
+#include "utils/trace.hpp"
+
+#include <signal.h>
+
+#include <chrono>
+
+void add_service_arguments(argparse::ArgumentParser &parser) {
+  parser.add_argument("--server-ip", "-s")
+      .default_value<std::string>("127.0.0.1");
+  parser.add_argument("--server-port", "-p")
+      .default_value<uint16_t>(7814)
+      .scan<'i', uint16_t>();
+  parser.add_argument("--unix-socket")
+      .metavar("PATH")
+      .help("listen on this unix domain socket instead of --server-ip and "
+            "--server-port, a leading '@' means the abstract namespace");
+  parser.add_argument("--backlog-size", "-b")
+      .default_value<int>(1)
+      .scan<'i', int>();
+  parser.add_argument("--protocol")
+      .default_value<std::string>("text")
+      .help("wire protocol: text, binary or batch");
+  parser.add_argument("--socket-options")
+      .default_value<std::string>("default")
+      .metavar("PRESET")
+      .help("socket options of the connections: default, low-latency or "
+            "throughput");
+  parser.add_argument("--max-depth")
+      .default_value<size_t>(128)
+      .scan<'u', size_t>()
+      .metavar("UINT")
+      .help("max nesting depth of an expression (0 means unlimited)");
+  parser.add_argument("--max-tokens")
+      .default_value<size_t>(4096)
+      .scan<'u', size_t>()
+      .metavar("UINT")
+      .help("max number of tokens of an expression (0 means unlimited)");
+  parser.add_argument("--max-steps")
+      .default_value<size_t>(4096)
+      .scan<'u', size_t>()
+      .metavar("UINT")
+      .help("max evaluation steps of an expression (0 means unlimited)");
+  parser.add_argument("--cache-file")
+      .metavar("PATH")
+      .help("persistent result cache, loaded at startup (disabled if not "
+            "given)");
+  parser.add_argument("--cache-capacity")
+      .default_value<size_t>(1 << 20)
+      .scan<'u', size_t>()
+      .metavar("UINT")
+      .help("number of entries of the result cache");
+  parser.add_argument("--admin-port")
+      .default_value<uint16_t>(0)
+      .scan<'i', uint16_t>()
+      .metavar("PORT")
+      .help("serve metrics in the Prometheus text format on this port of "
+            "--server-ip (0 means disabled), GET /trace returns the trace "
+            "events");
+  parser.add_argument("--trace-file")
+      .metavar("PATH")
+      .help("dump trace events as Chrome trace JSON into PATH on SIGUSR1 "
+            "(trace points need a build with ENABLE_TRACING)");
+  parser.add_argument("--log-queue-size")
+      .default_value<size_t>(8192)
+      .scan<'u', size_t>()
+      .metavar("UINT")
+      .help("log from a background thread through a queue of this many "
+            "messages, the oldest are dropped when it is full (0 means "
+            "synchronous logging)");
+  parser.add_argument("--timer-report-interval")
+      .default_value<size_t>(60)
+      .scan<'u', size_t>()
+      .metavar("SECONDS")
+      .help("log the percentiles of the scope timers this often (0 means "
+            "only at exit)");
+  parser.add_argument("--tcp-info-interval")
+      .default_value<size_t>(1000)
+      .scan<'u', size_t>()
+      .metavar("MS")
+      .help("sample TCP_INFO of the connections this often (0 means "
+            "disabled)");
+}
+
+service_context apply_service_arguments(argparse::ArgumentParser &parser) {
+  service_context context;
+  // before any other thread is created
+  if (auto trace_file = parser.present("--trace-file")) {
+    dump_trace_on_signal(SIGUSR1, *trace_file);
+  }
+  if (size_t log_queue_size = parser.get<size_t>("--log-queue-size")) {
+    use_async_logging(log_queue_size);
+  }
+  TimerRegistry::instance().log_every(
+      std::chrono::seconds(parser.get<size_t>("--timer-report-interval")));
+
+  std::string server_ip = parser.get<std::string>("--server-ip");
+  context.socket_options =
+      SocketOptions::preset(parser.get<std::string>("--socket-options"));
+  context.socket_options.reuse_address = true;
+  context.socket_options.reuse_port = true;
+  INFO("socket options: {}", context.socket_options);
+  context.endpoint = {server_ip, parser.get<uint16_t>("--server-port")};
+  if (auto unix_socket = parser.present("--unix-socket")) {
+    context.endpoint = Endpoint::unix_socket(*unix_socket);
+  }
+
+  evaluation_limits limits{parser.get<size_t>("--max-depth"),
+                           parser.get<size_t>("--max-tokens"),
+                           parser.get<size_t>("--max-steps")};
+  set_evaluation_limits(limits);
+  if (auto cache_file = parser.present("--cache-file")) {
+    context.cache = std::make_unique<ResultCache>(
+        *cache_file, parser.get<size_t>("--cache-capacity"), limits);
+    set_result_cache(context.cache.get());
+  }
+  if (uint16_t admin_port = parser.get<uint16_t>("--admin-port")) {
+    context.metrics_server =
+        std::make_unique<MetricsServer>(server_ip, admin_port);
+  }
+  return context;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "result_cache.hpp"
+#include "utils/common.hpp"
+#include "utils/endpoint.hpp"
+#include "utils/metrics.hpp"
+#include "utils/socket_options.hpp"
+
+#include <memory>
+
+// options every server accepts: where to listen, wire protocol, socket
+// options, evaluation limits, result cache, metrics, tracing and logging
+void add_service_arguments(argparse::ArgumentParser &parser);
+
+// what apply_service_arguments() set up, the cache and the metrics server live
+// as long as this
+struct service_context {
+  Endpoint endpoint;
+  SocketOptions socket_options;
+  std::unique_ptr<ResultCache> cache;
+  std::unique_ptr<MetricsServer> metrics_server;
+};
+
+// apply the options of add_service_arguments() to the process, call it before
+// any other thread is created
+service_context apply_service_arguments(argparse::ArgumentParser &parser);
@@ -0,0 +1,220 @@
+#include "workload.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <charconv>
+#include <iterator>
+
+std::ostream &operator<<(std::ostream &os, const workload_profile &profile) {
+  return os << fmt::format("operands: {}, depth: {}, multiply ratio: {}, "
+                           "operand digits: {}, keys: {}, hot ratio: {}, "
+                           "hot keys: {}",
+                           profile.operands, profile.depth,
+                           profile.multiply_ratio, profile.operand_digits,
+                           profile.keys, profile.hot_ratio, profile.hot_keys);
+}
+
+// append an expression of `profile.operands` operands to `out` and return
+// its value, wrapping around like the int arithmetic of the server
+static uint32_t generate(std::string &out, size_t depth,
+                         const workload_profile &profile,
+                         std::mt19937 &rand) {
+  static constexpr uint32_t powers_of_ten[] = {
+      1,      10,      100,      1000,      10000,
+      100000, 1000000, 10000000, 100000000, 1000000000};
+  std::uniform_int_distribution<uint32_t> operand(
+      0, powers_of_ten[profile.operand_digits] - 1);
+  std::bernoulli_distribution multiply(profile.multiply_ratio);
+  std::uniform_int_distribution<size_t> position(0, profile.operands - 1);
+
+  size_t nested = depth > 0 ? position(rand) : profile.operands;
+  // `*` binds tighter, i.e. the value is a sum of products
+  uint32_t sum = 0;
+  uint32_t product = 1;
+  for (size_t i = 0; i < profile.operands; i++) {
+    if (i > 0) {
+      if (multiply(rand)) {
+        out.push_back('*');
+      } else {
+        out.push_back('+');
+        sum += product;
+        product = 1;
+      }
+    }
+    uint32_t value;
+    if (i == nested) {
+      out.push_back('(');
+      value = generate(out, depth - 1, profile, rand);
+      out.push_back(')');
+    } else {
+      value = operand(rand);
+      fmt::format_to(std::back_inserter(out), "{}", value);
+    }
+    product *= value;
+  }
+  return sum + product;
+}
+
+GeneratedWorkload::GeneratedWorkload(const workload_profile &profile,
+                                     uint32_t seed)
+    : profile(profile) {
+  if (profile.operands == 0 || profile.operand_digits == 0 ||
+      profile.operand_digits > 9 || profile.keys == 0) {
+    THROW("invalid workload profile: {}", profile);
+  }
+  this->profile.hot_keys = std::clamp<size_t>(profile.hot_keys, 1, profile.keys);
+  std::mt19937 rand(seed);
+  // views are taken after the storage stopped growing
+  std::vector<std::pair<size_t, int>> expressions;
+  expressions.reserve(profile.keys);
+  for (size_t i = 0; i < profile.keys; i++) {
+    size_t begin = storage.size();
+    int value = static_cast<int>(generate(storage, profile.depth, profile, rand));
+    if (storage.size() - begin > max_expression_size) {
+      THROW("generated an expression of {} bytes, the frame limit is {} "
+            "bytes, reduce the depth, operands or operand digits of {}",
+            storage.size() - begin, max_expression_size, profile);
+    }
+    expressions.emplace_back(begin, value);
+  }
+  requests.reserve(profile.keys);
+  for (size_t i = 0; i < expressions.size(); i++) {
+    auto [begin, value] = expressions[i];
+    size_t end =
+        i + 1 < expressions.size() ? expressions[i + 1].first : storage.size();
+    requests.push_back(
+        {std::string_view(storage).substr(begin, end - begin), value});
+  }
+  INFO("generated {} expressions ({} bytes), {}", requests.size(),
+       storage.size(), this->profile);
+}
+
+RequestData GeneratedWorkload::next(std::mt19937 &rand,
+                                    size_t & /* position */) const {
+  std::bernoulli_distribution hot(profile.hot_ratio);
+  size_t n_keys = hot(rand) ? profile.hot_keys : requests.size();
+  return requests[std::uniform_int_distribution<size_t>(0, n_keys - 1)(rand)];
+}
+
+// the line at `position` without its line ending, `position` is advanced to
+// the next line
+static std::string_view get_line(std::string_view data, size_t &position) {
+  size_t end = std::min(data.find('\n', position), data.size());
+  std::string_view line = data.substr(position, end - position);
+  position = end + 1;
+  if (!line.empty() && line.back() == '\r') {
+    line.remove_suffix(1);
+  }
+  return line;
+}
+
+// an optional '-' followed by decimal digits, in the range of int
+static std::optional<int> parse_value(std::string_view text) {
+  int value;
+  const char *last = text.data() + text.size();
+  auto [end, ec] = std::from_chars(text.data(), last, value);
+  if (ec != std::errc{} || end != last) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+// throw if an expression of the trace exceeds max_expression_size, an
+// expected value is malformed or there is no expression at all
+static void check_trace(const std::filesystem::path &path,
+                        std::string_view data) {
+  size_t n_expressions = 0;
+  size_t position = 0;
+  for (size_t line_number = 1; position < data.size(); line_number++) {
+    std::string_view line = get_line(data, position);
+    if (line.empty()) {
+      continue;
+    }
+    size_t equal = line.find('=');
+    std::string_view expression = line.substr(0, equal);
+    if (expression.empty()) {
+      THROW("trace {} line {}: no expression before '='", path.string(),
+            line_number);
+    }
+    if (expression.size() > max_expression_size) {
+      THROW("trace {} line {}: expression of {} bytes, the frame limit is {} "
+            "bytes",
+            path.string(), line_number, expression.size(),
+            max_expression_size);
+    }
+    if (equal != std::string_view::npos &&
+        !parse_value(line.substr(equal + 1))) {
+      THROW("trace {} line {}: expected value {} is not an integer",
+            path.string(), line_number, escaped(line.substr(equal + 1)));
+    }
+    n_expressions++;
+  }
+  if (n_expressions == 0) {
+    THROW("trace {} contains no expression", path.string());
+  }
+}
+
+TraceWorkload::TraceWorkload(const std::filesystem::path &path) {
+  int fd;
+  CHECK(fd = ::open(path.c_str(), O_RDONLY));
+  struct stat file_stat {};
+  if (::fstat(fd, &file_stat) == -1 || file_stat.st_size == 0) {
+    ::close(fd);
+    THROW("trace {} is empty or unreadable", path.string());
+  }
+  mapped_size = file_stat.st_size;
+  void *addr = ::mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int _errno = errno;
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    THROW("failed to map trace {}: {}", path.string(),
+          get_errno_string(_errno));
+  }
+  mapped = static_cast<const char *>(addr);
+  // the trace is streamed front to back
+  ::madvise(addr, mapped_size, MADV_SEQUENTIAL);
+  try {
+    check_trace(path, std::string_view(mapped, mapped_size));
+  } catch (...) {
+    ::munmap(addr, mapped_size);
+    throw;
+  }
+  INFO("replay trace {} ({} bytes)", path.string(), mapped_size);
+}
+
+TraceWorkload::~TraceWorkload() {
+  if (mapped) {
+    ::munmap(const_cast<char *>(mapped), mapped_size);
+  }
+}
+
+RequestData TraceWorkload::next(std::mt19937 & /* rand */,
+                                size_t &position) const {
+  std::string_view line;
+  // skip empty lines, the constructor made sure there is an expression and
+  // every expected value is valid
+  while (line.empty()) {
+    if (position >= mapped_size) {
+      position = 0;
+    }
+    line = get_line({mapped, mapped_size}, position);
+  }
+  size_t equal = line.find('=');
+  if (equal == std::string_view::npos) {
+    return {line};
+  }
+  return {line.substr(0, equal), parse_value(line.substr(equal + 1))};
+}
+
+size_t TraceWorkload::start_position(size_t index, size_t count) const {
+  if (index == 0) {
+    return 0;
+  }
+  // the line following the even split point
+  size_t offset = mapped_size / count * index;
+  const char *end = static_cast<const char *>(
+      memchr(mapped + offset, '\n', mapped_size - offset));
+  return end == nullptr ? 0 : end - mapped + 1;
+}
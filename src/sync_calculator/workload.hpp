@@ -0,0 +1,103 @@
+#pragma once
+
+#include "codec.hpp"
+#include "utils/buffer.hpp"
+#include "utils/common.hpp"
+
+#include <filesystem>
+#include <random>
+#include <vector>
+
+// shape of the expressions of a generated workload
+struct workload_profile {
+  // operands per (parenthesised) sub expression
+  size_t operands{2};
+  // nesting depth of parentheses, one operand of each level is replaced by
+  // the next level
+  size_t depth{};
+  // fraction of `*` among the operators, the rest is `+`
+  double multiply_ratio{};
+  // decimal digits per operand, at most 9 so that it fits into int
+  size_t operand_digits{6};
+  // distinct expressions generated up front
+  size_t keys{1 << 20};
+  // fraction of the requests drawn from the first `hot_keys` expressions
+  double hot_ratio{};
+  size_t hot_keys{64};
+};
+
+std::ostream &operator<<(std::ostream &os, const workload_profile &profile);
+
+template <> struct fmt::formatter<workload_profile> : ostream_formatter {};
+
+// longest expression a request frame can carry with the FixedBuffer<1024> of
+// the requesters and responsers, a longer one would never leave the queue
+constexpr size_t max_expression_size =
+    FixedBuffer<1024>::capacity - header_size;
+
+// Source of the expressions a load generator sends, shared read only by all
+// of its threads. The RequestData handed out point into memory owned by the
+// workload, so it must outlive every request.
+class Workload {
+public:
+  virtual ~Workload() = default;
+
+  // the request at `position`, which is advanced to the next one
+  virtual RequestData next(std::mt19937 &rand, size_t &position) const = 0;
+  // where thread `index` out of `count` starts
+  virtual size_t start_position(size_t index, size_t count) const {
+    return 0;
+  }
+};
+
+// a pool of random expressions following a workload_profile, generated once
+// so that issuing a request does not allocate
+class GeneratedWorkload : public Workload {
+public:
+  GeneratedWorkload(const workload_profile &profile, uint32_t seed);
+
+  RequestData next(std::mt19937 &rand, size_t &position) const override;
+
+private:
+  workload_profile profile;
+  std::string storage{};
+  std::vector<RequestData> requests{};
+};
+
+// Replay of a recorded trace, one expression per line, optionally followed
+// by `=<value>` to verify the responses. The file is memory mapped and the
+// requests point directly into the mapping, threads start at evenly spaced
+// lines and wrap around at the end. Lines may end with "\r\n", every line is
+// checked against max_expression_size and for a valid value when the trace
+// is loaded.
+class TraceWorkload : public Workload {
+public:
+  explicit TraceWorkload(const std::filesystem::path &path);
+  ~TraceWorkload() override;
+
+  TraceWorkload(const TraceWorkload &) = delete;
+  TraceWorkload &operator=(const TraceWorkload &) = delete;
+
+  RequestData next(std::mt19937 &rand, size_t &position) const override;
+  size_t start_position(size_t index, size_t count) const override;
+
+private:
+  const char *mapped{};
+  size_t mapped_size{};
+};
+
+// the requests of one load generating thread
+class WorkloadStream {
+public:
+  WorkloadStream(const Workload &workload, uint32_t seed, size_t index = 0,
+                 size_t count = 1)
+      : workload(&workload), rand(seed),
+        position(workload.start_position(index, count)) {}
+
+  RequestData next() { return workload->next(rand, position); }
+
+private:
+  const Workload *workload;
+  std::mt19937 rand;
+  size_t position;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <string_view>
+
+// Fixed capacity I/O buffer, readable data is always kept contiguous at the
+// front, so that a frame never wraps around. Used as the `Buffer` policy of
+// Connection, the capacity bounds the largest frame that can be received.
+template <size_t N> class FixedBuffer {
+public:
+  static constexpr size_t capacity = N;
+
+  char *write_ptr() { return data_.data() + size_; }
+  size_t writable() const { return N - size_; }
+  void commit(size_t n) { size_ += n; }
+
+  std::string_view readable() const { return {data_.data(), size_}; }
+  bool empty() const { return size_ == 0; }
+  // drop the first `n` bytes and move the rest to the front
+  // TODO: use ring buffer to make here more efficient ?
+  void consume(size_t n) {
+    std::copy(data_.data() + n, data_.data() + size_, data_.data());
+    size_ -= n;
+  }
+
+private:
+  std::array<char, N> data_{};
+  size_t size_ = 0;
+};
@@ -2,28 +2,33 @@
 #include "utils/common.hpp"
 #include "utils/exceptions.hpp"
 
-void Client::create_socket() {
-  CHECK(fd_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+void Client::create_socket(const SocketOptions &options) {
+  CHECK(fd_ = ::socket(remote_endpoint_.family(), SOCK_STREAM, 0));
+  try {
+    options.apply_connection(fd_, remote_endpoint_.family());
+  } catch (...) {
+    ::close(fd_);
+    throw;
+  }
 }
 
-Client::Client(std::string_view remote_ip, uint16_t remote_port) {
-  remote_endpoint_.sin_family = AF_INET;
-  remote_endpoint_.sin_port = ::htons(remote_port);
-  set_addr(remote_endpoint_, remote_ip);
-  create_socket();
+Client::Client(const Endpoint &remote_endpoint,
+               const SocketOptions &options) {
+  remote_endpoint_ = remote_endpoint;
+  create_socket(options);
 }
 
-Client::Client(uint16_t remote_port) {
-  remote_endpoint_.sin_family = AF_INET;
-  remote_endpoint_.sin_port = ::htons(remote_port);
-  remote_endpoint_.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
-  create_socket();
-}
+Client::Client(std::string_view remote_ip, uint16_t remote_port,
+               const SocketOptions &options)
+    : Client(Endpoint{remote_ip, remote_port}, options) {}
+
+Client::Client(uint16_t remote_port, const SocketOptions &options)
+    : Client(Endpoint{remote_port}, options) {}
 
 void Client::connect() {
   // connect 对于非阻塞
   int ret =
-      ::connect(fd_, SOCKADDR(remote_endpoint_), sizeof(remote_endpoint_));
+      ::connect(fd_, remote_endpoint_.data(), remote_endpoint_.size());
   if (ret == -1) {
     int _errno = errno;
     if (would_block(_errno) || _errno == EINPROGRESS) {
@@ -33,10 +38,13 @@ void Client::connect() {
   }
 }
 
-const struct sockaddr_in &Client::local_endpoint() {
-  if (local_endpoint_.sin_port == 0) {
-    socklen_t size = sizeof(local_endpoint_);
-    CHECK(getsockname(fd_, SOCKADDR(local_endpoint_), &size));
+const Endpoint &Client::local_endpoint() {
+  // not bound before connect()
+  if (local_endpoint_.size() == 0 ||
+      (local_endpoint_.is_inet() && local_endpoint_.inet().sin_port == 0)) {
+    socklen_t size = Endpoint::capacity();
+    CHECK(getsockname(fd_, local_endpoint_.data(), &size));
+    local_endpoint_.resize(size);
   }
   return local_endpoint_;
 }
\ No newline at end of file
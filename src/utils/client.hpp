@@ -9,17 +9,20 @@ class Client : public Session {
 public:
   Client() = default;
 
-  Client(std::string_view remote_ip, uint16_t remote_port);
+  Client(const Endpoint &remote_endpoint, const SocketOptions &options = {});
 
-  Client(uint16_t remote_port);
+  Client(std::string_view remote_ip, uint16_t remote_port,
+         const SocketOptions &options = {});
+
+  Client(uint16_t remote_port, const SocketOptions &options = {});
 
   void connect();
-  const struct sockaddr_in &local_endpoint();
+  const Endpoint &local_endpoint();
 
   friend struct std::hash<Client>;
 
 private:
-  void create_socket();
+  void create_socket(const SocketOptions &options);
 };
 
 namespace std {
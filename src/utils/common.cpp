@@ -2,6 +2,9 @@
 
 #include <unordered_map>
 
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
 std::ostream &operator<<(std::ostream &os, const struct sockaddr_in &addr) {
   return os << fmt::format("{}:{}", inet_ntoa(addr.sin_addr),
                            ntohs(addr.sin_port));
@@ -248,4 +251,12 @@ std::string octet_stream(std::string_view data) {
   }
   s << '\'';
   return s.str();
-}
\ No newline at end of file
+}
+
+void use_async_logging(size_t queue_size) {
+  spdlog::init_thread_pool(queue_size, 1);
+  auto logger = spdlog::stdout_color_mt<spdlog::async_factory_nonblock>(
+      "async");
+  logger->set_level(spdlog::default_logger()->level());
+  spdlog::set_default_logger(logger);
+}
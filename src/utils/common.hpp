@@ -15,6 +15,7 @@
 
 #include "exceptions.hpp"
 #include "spdlog/spdlog.h"
+#include "timer.hpp"
 
 std::ostream &operator<<(std::ostream &os, const struct sockaddr_in &addr);
 
@@ -30,50 +31,58 @@ struct fmt::formatter<argparse::ArgumentParser> : ostream_formatter {};
                                     fmt::format(__VA_ARGS__)));                \
   } while (0)
 
-#define TRACE(...)                                                             \
-  do {                                                                         \
-    spdlog::trace("{}:{} {}", __FILE__, __LINE__, fmt::format(__VA_ARGS__));   \
-  } while (0)
+// Log statements below LOG_ACTIVE_LEVEL (a SPDLOG_LEVEL_* value, see
+// LOG_ACTIVE_LEVEL in CMakeLists.txt) are compiled out, the others evaluate
+// their arguments only if the level is enabled at runtime, so a disabled
+// DEBUG("{}", escaped(data)) never builds the string.
+#ifndef LOG_ACTIVE_LEVEL
+#define LOG_ACTIVE_LEVEL SPDLOG_LEVEL_TRACE
+#endif
 
-#define DEBUG(...)                                                             \
+#define LOG_IF_ENABLED(level, ...)                                             \
   do {                                                                         \
-    spdlog::debug(__VA_ARGS__);                                                \
-  } while (0)
-
-#define INFO(...)                                                              \
-  do {                                                                         \
-    spdlog::info(__VA_ARGS__);                                                 \
+    if (spdlog::should_log(level)) {                                           \
+      spdlog::log(level, __VA_ARGS__);                                         \
+    }                                                                          \
   } while (0)
 
-#define ERROR(...)                                                             \
+// never logs, but keeps the arguments referenced and type checked, so that
+// every LOG_ACTIVE_LEVEL builds without unused variable warnings
+#define LOG_DISABLED(...)                                                      \
   do {                                                                         \
-    spdlog::error("{}:{} {}", __FILE__, __LINE__, fmt::format(__VA_ARGS__));   \
+    if (false) {                                                               \
+      spdlog::log(spdlog::level::trace, __VA_ARGS__);                          \
+    }                                                                          \
   } while (0)
 
-class scope_timer {
-public:
-  scope_timer(std::string_view name)
-      : scope_name_{name}, enter_time_{std::chrono::steady_clock::now()} {}
-
-  ~scope_timer() {
-    std::chrono::steady_clock::time_point exit_time_{
-        std::chrono::steady_clock::now()};
-    spdlog::info("{} cost: {} ms", scope_name_,
-                  std::chrono::duration_cast<std::chrono::milliseconds>(
-                      exit_time_ - enter_time_)
-                      .count());
-  }
-
-private:
-  std::string_view scope_name_{};
-  std::chrono::steady_clock::time_point enter_time_{};
-};
+#if LOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE
+#define TRACE(...)                                                             \
+  LOG_IF_ENABLED(spdlog::level::trace, "{}:{} {}", __FILE__, __LINE__,         \
+                 fmt::format(__VA_ARGS__))
+#else
+#define TRACE(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if LOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+#define DEBUG(...) LOG_IF_ENABLED(spdlog::level::debug, __VA_ARGS__)
+#else
+#define DEBUG(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if LOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_INFO
+#define INFO(...) LOG_IF_ENABLED(spdlog::level::info, __VA_ARGS__)
+#else
+#define INFO(...) LOG_DISABLED(__VA_ARGS__)
+#endif
 
-#define TIMER_BEGIN(name)                                                      \
-  {                                                                            \
-    scope_timer __timer(name);
+#define ERROR(...)                                                             \
+  LOG_IF_ENABLED(spdlog::level::err, "{}:{} {}", __FILE__, __LINE__,           \
+                 fmt::format(__VA_ARGS__))
 
-#define TIMER_END() }
+// send the default logger through a background thread with a bounded queue of
+// `queue_size` messages, when full the oldest ones are dropped instead of
+// blocking the caller
+void use_async_logging(size_t queue_size);
 
 #define CHECK(expr)                                                            \
   do {                                                                         \
@@ -98,8 +107,8 @@ constexpr size_t header_size = sizeof(header);
 inline void set_content_size(char *data, header data_size) {
   reinterpret_cast<header *>(data)->size = htons(data_size.size);
 }
-inline header get_content_size(char *data) {
-  return {ntohs(reinterpret_cast<header *>(data)->size)};
+inline header get_content_size(const char *data) {
+  return {ntohs(reinterpret_cast<const header *>(data)->size)};
 }
 
 inline int stoi(std::string_view v) {
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "buffer.hpp"
+#include "common.hpp"
+#include "exceptions.hpp"
+#include "shm_channel.hpp"
+#include "trace.hpp"
+
+#include <unistd.h>
+
+#include <utility>
+
+// the default Stream of Connection, a connected socket
+class SocketStream {
+public:
+  SocketStream() = default;
+  SocketStream(int fd) : fd(fd) {}
+
+  int handle() const { return fd; }
+  ssize_t read(char *data, size_t size) { return ::read(fd, data, size); }
+  ssize_t write(const char *data, size_t size) {
+    return ::write(fd, data, size);
+  }
+
+private:
+  int fd{};
+};
+
+// invoke `f(Stream{})` with the stream called `name`, "socket" or "shm", used
+// to pick the instantiation from the command line
+template <typename F> void with_stream(std::string_view name, F &&f) {
+  if (name == "socket") {
+    f(SocketStream{});
+  } else if (name == "shm") {
+    f(ShmChannel{});
+  } else {
+    THROW("unknown transport: {}, expect socket or shm", name);
+  }
+}
+
+// Buffered, framed and non-blocking aware I/O on a connected stream, shared by
+// Requester and Responser. Everything protocol specific is a compile time
+// policy, so each combination is fully inlined:
+//
+// - `Codec` turns messages into frames and back, see sync_calculator/codec.hpp
+//     template <typename Queue>
+//     static size_t encode(char *out, size_t available, Queue &messages);
+//     template <typename Message, typename F>
+//     static size_t decode(std::string_view data, F &&on_message);
+// - `Buffer` stores pending bytes of each direction, see FixedBuffer
+// - `Stream` moves the bytes, SocketStream or ShmChannel (see shm_channel.hpp)
+//     int handle() const;  // the fd to wait on
+//     ssize_t read(char *data, size_t size);  // like ::read
+//     ssize_t write(const char *data, size_t size);  // like ::write
+template <typename Codec, typename Buffer, typename Stream = SocketStream>
+class Connection {
+public:
+  Connection() = default;
+  Connection(Stream stream) : stream(std::move(stream)) {}
+
+  int handle() const { return stream.handle(); }
+  // encoded bytes not accepted by the socket yet
+  bool has_pending_writes() const { return !send_buffer.empty(); }
+
+  // encode as many `messages` as fit into the send buffer (they are popped)
+  // and write the buffer, return the number of bytes written, throw
+  // send_error on failure
+  template <typename Queue> size_t write(Queue &messages) {
+    if (!messages.empty()) {
+      send_buffer.commit(Codec::encode(send_buffer.write_ptr(),
+                                       send_buffer.writable(), messages));
+    }
+    if (send_buffer.empty()) {
+      return 0;
+    }
+    std::string_view data = send_buffer.readable();
+    ssize_t bytes_written;
+    {
+      TRACE_SCOPE("write");
+      bytes_written = stream.write(data.data(), data.size());
+    }
+    // 检查返回值，是否是 EAGAIN or EWOULDBLOCK
+    if (bytes_written == -1) {
+      int _errno = errno;
+      if (would_block(_errno)) {
+        return 0;
+      }
+      throw send_error(get_errno_string(_errno));
+    }
+    DEBUG("send: {}", escaped(data.substr(0, bytes_written)));
+    send_buffer.consume(bytes_written);
+    return bytes_written;
+  }
+
+  // read once and invoke `on_message(Message)` for every message of all
+  // complete frames, an incomplete frame is kept for the next read, return
+  // the number of bytes read, throw eof_error if the peer closed the
+  // connection and recv_error on failure
+  template <typename Message, typename F> size_t read(F &&on_message) {
+    if (recv_buffer.writable() == 0) {
+      throw recv_error("frame exceeds receive buffer of {} bytes",
+                       Buffer::capacity);
+    }
+    ssize_t bytes_received;
+    {
+      TRACE_SCOPE("read");
+      bytes_received =
+          stream.read(recv_buffer.write_ptr(), recv_buffer.writable());
+    }
+    if (bytes_received == 0) {
+      throw eof_error();
+    } else if (bytes_received == -1) {
+      int _errno = errno;
+      if (would_block(_errno)) {
+        return 0;
+      }
+      throw recv_error(get_errno_string(_errno));
+    }
+    DEBUG("recv: {}",
+          escaped(std::string_view(recv_buffer.write_ptr(), bytes_received)));
+    recv_buffer.commit(bytes_received);
+    recv_buffer.consume(Codec::template decode<Message>(
+        recv_buffer.readable(), std::forward<F>(on_message)));
+    return bytes_received;
+  }
+
+private:
+  Stream stream{};
+  Buffer send_buffer{};
+  Buffer recv_buffer{};
+};
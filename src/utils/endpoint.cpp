@@ -0,0 +1,82 @@
+#include "endpoint.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+static constexpr socklen_t path_offset = offsetof(struct sockaddr_un, sun_path);
+
+Endpoint::Endpoint(std::string_view ip, uint16_t port) {
+  struct sockaddr_in addr {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = ::htons(port);
+  set_addr(addr, ip);
+  ::memcpy(&address_, &addr, sizeof(addr));
+  size_ = sizeof(addr);
+}
+
+Endpoint::Endpoint(uint16_t port) {
+  struct sockaddr_in addr {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = ::htons(port);
+  addr.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+  ::memcpy(&address_, &addr, sizeof(addr));
+  size_ = sizeof(addr);
+}
+
+Endpoint Endpoint::unix_socket(std::string_view path) {
+  struct sockaddr_un addr {};
+  addr.sun_family = AF_UNIX;
+  // named paths need the terminating 0
+  if (path.empty() || path.size() + 1 > sizeof(addr.sun_path)) {
+    THROW("unix socket path {} is empty or longer than {} bytes", path,
+          sizeof(addr.sun_path) - 1);
+  }
+  Endpoint endpoint;
+  ::memcpy(addr.sun_path, path.data(), path.size());
+  if (path[0] == '@') {
+    // abstract, the length tells where the name ends
+    addr.sun_path[0] = '\0';
+    endpoint.size_ = path_offset + path.size();
+  } else {
+    endpoint.size_ = path_offset + path.size() + 1;
+  }
+  ::memcpy(&endpoint.address_, &addr, sizeof(addr));
+  return endpoint;
+}
+
+const struct sockaddr_in &Endpoint::inet() const {
+  if (!is_inet()) {
+    THROW("{} is not an IPv4 endpoint", *this);
+  }
+  return *reinterpret_cast<const struct sockaddr_in *>(&address_);
+}
+
+std::string Endpoint::path() const {
+  if (!is_unix()) {
+    THROW("{} is not a unix socket endpoint", *this);
+  }
+  const auto &addr = *reinterpret_cast<const struct sockaddr_un *>(&address_);
+  if (size_ <= path_offset) {
+    return {};
+  }
+  size_t length = size_ - path_offset;
+  if (addr.sun_path[0] == '\0') {
+    return "@" + std::string(addr.sun_path + 1, length - 1);
+  }
+  return std::string(addr.sun_path, ::strnlen(addr.sun_path, length));
+}
+
+bool Endpoint::operator==(const Endpoint &b) const noexcept {
+  return size_ == b.size_ && ::memcmp(&address_, &b.address_, size_) == 0;
+}
+
+std::ostream &operator<<(std::ostream &os, const Endpoint &endpoint) {
+  if (endpoint.is_inet()) {
+    return os << endpoint.inet();
+  }
+  if (endpoint.is_unix()) {
+    std::string path = endpoint.path();
+    return os << "unix:" << (path.empty() ? "(unnamed)" : path);
+  }
+  return os << fmt::format("(address family {})", endpoint.family());
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <sys/un.h>
+
+#include <string>
+#include <string_view>
+
+// Address of a stream socket, IPv4 or unix domain (see unix(7)). Unix paths
+// starting with '@' are in the abstract namespace, they have no file and go
+// away with the last socket.
+class Endpoint {
+public:
+  Endpoint() = default;
+  Endpoint(std::string_view ip, uint16_t port);
+  // loopback
+  explicit Endpoint(uint16_t port);
+
+  static Endpoint unix_socket(std::string_view path);
+
+  int family() const { return address_.ss_family; }
+  bool is_inet() const { return family() == AF_INET; }
+  bool is_unix() const { return family() == AF_UNIX; }
+
+  // for connect() and bind()
+  const struct sockaddr *data() const {
+    return reinterpret_cast<const struct sockaddr *>(&address_);
+  }
+  socklen_t size() const { return size_; }
+
+  // for accept() and getsockname(), pass capacity() as the size and resize()
+  // to the size returned
+  struct sockaddr *data() {
+    return reinterpret_cast<struct sockaddr *>(&address_);
+  }
+  static constexpr socklen_t capacity() {
+    return sizeof(struct sockaddr_storage);
+  }
+  void resize(socklen_t size) { size_ = size; }
+
+  // throw program_error unless is_inet()
+  const struct sockaddr_in &inet() const;
+  // "" for unnamed unix sockets (e.g. connected clients), throw program_error
+  // unless is_unix()
+  std::string path() const;
+
+  bool operator==(const Endpoint &b) const noexcept;
+
+private:
+  struct sockaddr_storage address_ {};
+  socklen_t size_{};
+};
+
+// ip:port, unix:path or unix:(unnamed)
+std::ostream &operator<<(std::ostream &os, const Endpoint &endpoint);
+
+template <> struct fmt::formatter<Endpoint> : ostream_formatter {};
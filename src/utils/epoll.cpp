@@ -0,0 +1,42 @@
+#include "epoll.hpp"
+
+#include <unistd.h>
+
+Epoll::Epoll(size_t max_events) : events(max_events) {
+  CHECK(fd_ = ::epoll_create1(EPOLL_CLOEXEC));
+}
+
+Epoll::~Epoll() {
+  if (fd_ != -1) {
+    ::close(fd_);
+  }
+}
+
+void Epoll::add(int fd, uint32_t events, uint64_t key) {
+  epoll_event event{};
+  event.events = events;
+  event.data.u64 = key;
+  CHECK(::epoll_ctl(fd_, EPOLL_CTL_ADD, fd, &event));
+}
+
+void Epoll::modify(int fd, uint32_t events, uint64_t key) {
+  epoll_event event{};
+  event.events = events;
+  event.data.u64 = key;
+  CHECK(::epoll_ctl(fd_, EPOLL_CTL_MOD, fd, &event));
+}
+
+void Epoll::remove(int fd) {
+  CHECK(::epoll_ctl(fd_, EPOLL_CTL_DEL, fd, nullptr));
+}
+
+size_t Epoll::wait(int timeout_ms) {
+  int n_ready = ::epoll_wait(fd_, events.data(), events.size(), timeout_ms);
+  if (n_ready == -1) {
+    if (errno == EINTR) {
+      return 0;
+    }
+    THROW("{}", get_errno_string(errno));
+  }
+  return n_ready;
+}
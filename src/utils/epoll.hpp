@@ -0,0 +1,33 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <sys/epoll.h>
+
+#include <vector>
+
+// thin RAII wrapper of an epoll instance, every registered fd carries a
+// user defined 64 bit key (e.g. an index into a session table)
+class Epoll {
+public:
+  explicit Epoll(size_t max_events = 1024);
+  ~Epoll();
+
+  Epoll(const Epoll &) = delete;
+  Epoll &operator=(const Epoll &) = delete;
+
+  void add(int fd, uint32_t events, uint64_t key);
+  void modify(int fd, uint32_t events, uint64_t key);
+  void remove(int fd);
+
+  // wait at most `timeout_ms` (-1 means forever), ready events are available
+  // through events() until the next call, EINTR is reported as no event
+  size_t wait(int timeout_ms);
+  const epoll_event &event(size_t i) const { return events[i]; }
+
+  int handle() const { return fd_; }
+
+private:
+  int fd_{-1};
+  std::vector<epoll_event> events{};
+};
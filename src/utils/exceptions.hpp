@@ -1,6 +1,7 @@
 #pragma once
 
 #include <exception>
+#include <optional>
 
 #include <spdlog/fmt/bundled/ostream.h>
 
@@ -45,3 +46,45 @@ public:
   parse_error(fmt::format_string<Args...> fmt, Args &&...args)
       : base(fmt::format(fmt, args...)) {}
 };
+
+
+// expression rejected by the complexity limits of the calculator, the
+// connection stays open and an error frame is sent back instead
+class limit_error : public program_error {
+  using base = program_error;
+
+public:
+  enum limit_type { depth, tokens, steps };
+
+  template <typename... Args>
+  limit_error(limit_type type, fmt::format_string<Args...> fmt,
+              Args &&...args)
+      : base(fmt::format(fmt, args...)), type_(type) {}
+
+  limit_type type() const { return type_; }
+  std::string_view name() const { return type_name(type_); }
+
+  static std::string_view type_name(limit_type type) {
+    switch (type) {
+    case depth:
+      return "depth";
+    case tokens:
+      return "tokens";
+    case steps:
+      return "steps";
+    }
+    return "unknown";
+  }
+
+  static std::optional<limit_type> type_from_name(std::string_view name) {
+    for (limit_type type : {depth, tokens, steps}) {
+      if (type_name(type) == name) {
+        return type;
+      }
+    }
+    return std::nullopt;
+  }
+
+private:
+  limit_type type_;
+};
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include "histogram.hpp"
+#include "common.hpp"
+#include "exceptions.hpp"
+
+#include <cmath>
+#include <sstream>
+
+size_t Histogram::index_of(uint64_t value) {
+  if (value < 2 * half_sub_buckets) {
+    return value;
+  }
+  // keep the `sub_bucket_bits` most significant bits of value
+  int shift = (63 - __builtin_clzll(value)) - (sub_bucket_bits - 1);
+  return shift * half_sub_buckets + (value >> shift);
+}
+
+uint64_t Histogram::highest_equivalent_value(size_t index) {
+  if (index < 2 * half_sub_buckets) {
+    return index;
+  }
+  int shift = static_cast<int>(index / half_sub_buckets) - 1;
+  uint64_t lowest = static_cast<uint64_t>(index - shift * half_sub_buckets)
+                    << shift;
+  return lowest + ((uint64_t{1} << shift) - 1);
+}
+
+void Histogram::record(uint64_t value) {
+  counts[index_of(value)]++;
+  total_count++;
+  min_value = std::min(min_value, value);
+  max_value = std::max(max_value, value);
+  sum += value;
+}
+
+void Histogram::merge(const Histogram &other) {
+  for (size_t i = 0; i < n_counts; i++) {
+    counts[i] += other.counts[i];
+  }
+  total_count += other.total_count;
+  min_value = std::min(min_value, other.min_value);
+  max_value = std::max(max_value, other.max_value);
+  sum += other.sum;
+}
+
+void Histogram::reset() { *this = Histogram{}; }
+
+double Histogram::mean() const {
+  return total_count ? static_cast<double>(sum / total_count) : 0;
+}
+
+uint64_t Histogram::value_at_percentile(double percentile) const {
+  if (total_count == 0) {
+    return 0;
+  }
+  uint64_t target = static_cast<uint64_t>(
+      std::ceil(std::min(percentile, 100.0) / 100.0 * total_count));
+  target = std::max<uint64_t>(target, 1);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < n_counts; i++) {
+    seen += counts[i];
+    if (seen >= target) {
+      return std::min(highest_equivalent_value(i), max_value);
+    }
+  }
+  return max_value;
+}
+
+std::string Histogram::latency_summary() const {
+  auto us = [](uint64_t ns) { return ns / 1000.0; };
+  return fmt::format("p50: {:.1f} us, p90: {:.1f} us, p99: {:.1f} us, "
+                     "p99.9: {:.1f} us, max: {:.1f} us",
+                     us(value_at_percentile(50)), us(value_at_percentile(90)),
+                     us(value_at_percentile(99)),
+                     us(value_at_percentile(99.9)), us(max()));
+}
+
+std::string Histogram::encode() const {
+  // count min max sum, then index:count of every non-empty bucket
+  std::string text =
+      fmt::format("{} {} {} {}", total_count, min_value, max_value,
+                  static_cast<double>(sum));
+  for (size_t i = 0; i < n_counts; i++) {
+    if (counts[i] != 0) {
+      fmt::format_to(std::back_inserter(text), " {}:{}", i, counts[i]);
+    }
+  }
+  return text;
+}
+
+Histogram Histogram::decode(std::string_view text) {
+  Histogram histogram;
+  std::istringstream stream{std::string(text)};
+  double sum;
+  if (!(stream >> histogram.total_count >> histogram.min_value >>
+        histogram.max_value >> sum)) {
+    throw program_error("malformed histogram: {}", text);
+  }
+  histogram.sum = sum;
+  size_t index;
+  uint64_t count;
+  char colon;
+  uint64_t total = 0;
+  while (stream >> index >> colon >> count) {
+    if (colon != ':' || index >= n_counts) {
+      throw program_error("malformed histogram bucket {}", index);
+    }
+    histogram.counts[index] = count;
+    total += count;
+  }
+  if (total != histogram.total_count) {
+    throw program_error("histogram buckets sum up to {}, expect {}", total,
+                        histogram.total_count);
+  }
+  return histogram;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+
+// HDR style histogram of non-negative integer values (e.g. latencies in ns).
+// Values are grouped into power of two buckets, each split into linear sub
+// buckets, so the relative error is bounded by 1 / 2^(sub_bucket_bits - 1)
+// over the whole uint64_t range with a fixed footprint, and recording is a
+// couple of bit operations. Histograms are not thread safe, use one per
+// thread and merge() them at the end.
+class Histogram {
+public:
+  static constexpr int sub_bucket_bits = 8;
+
+  void record(uint64_t value);
+  void merge(const Histogram &other);
+  void reset();
+
+  uint64_t count() const { return total_count; }
+  uint64_t min() const { return total_count ? min_value : 0; }
+  uint64_t max() const { return max_value; }
+  double mean() const;
+  // highest value (up to the resolution of the histogram) below which
+  // `percentile` percent of all recorded values fall
+  uint64_t value_at_percentile(double percentile) const;
+
+  // p50 / p90 / p99 / p99.9 / max, values are nanoseconds
+  std::string latency_summary() const;
+
+  // single line text form, only non-empty buckets are listed, used to ship
+  // histograms between processes. decode() throws program_error if `text`
+  // is malformed
+  std::string encode() const;
+  static Histogram decode(std::string_view text);
+
+private:
+  static constexpr size_t half_sub_buckets = size_t{1} << (sub_bucket_bits - 1);
+  static constexpr size_t n_counts =
+      (64 - sub_bucket_bits) * half_sub_buckets + 2 * half_sub_buckets;
+
+  static size_t index_of(uint64_t value);
+  static uint64_t highest_equivalent_value(size_t index);
+
+  std::array<uint64_t, n_counts> counts{};
+  uint64_t total_count = 0;
+  uint64_t min_value = std::numeric_limits<uint64_t>::max();
+  uint64_t max_value = 0;
+  // long double, a sum of nanoseconds overflows uint64_t after ~584 years
+  long double sum = 0;
+};
@@ -0,0 +1,202 @@
+#include "loop_monitor.hpp"
+#include "metrics.hpp"
+
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstring>
+
+namespace ch = std::chrono;
+
+namespace {
+
+struct loop_metrics {
+  Counter stalls;
+  Counter slow_callbacks;
+  Counter watchdog_dumps;
+};
+
+const loop_metrics &get_loop_metrics() {
+  static const loop_metrics metrics = [] {
+    auto &registry = MetricsRegistry::instance();
+    return loop_metrics{
+        registry.counter("event_loop_stalls_total",
+                         "Loop iterations over the budget."),
+        registry.counter("event_loop_slow_callbacks_total",
+                         "Callbacks over the budget."),
+        registry.counter("event_loop_watchdog_dumps_total",
+                         "Iterations past the watchdog deadline."),
+    };
+  }();
+  return metrics;
+}
+
+// runs on the stalled loop thread, only async-signal-safe calls (backtrace()
+// is, once libgcc is loaded, see the constructor)
+void print_backtrace(int) {
+  std::array<void *, 64> frames;
+  int n_frames = ::backtrace(frames.data(), frames.size());
+  static constexpr char header[] = "event loop backtrace:\n";
+  ssize_t ignored = ::write(STDERR_FILENO, header, sizeof(header) - 1);
+  (void)ignored;
+  ::backtrace_symbols_fd(frames.data(), n_frames, STDERR_FILENO);
+}
+
+// a path does not fit into an atomic, unix socket peers become unnamed
+constexpr uint64_t unix_peer = uint64_t{1} << 63;
+
+uint64_t pack_peer(const Endpoint &peer) {
+  if (!peer.is_inet()) {
+    return unix_peer;
+  }
+  const auto &addr = peer.inet();
+  return uint64_t{addr.sin_addr.s_addr} << 16 | addr.sin_port;
+}
+
+Endpoint unpack_peer(uint64_t packed) {
+  if (packed == unix_peer) {
+    Endpoint endpoint;
+    endpoint.data()->sa_family = AF_UNIX;
+    endpoint.resize(sizeof(sa_family_t));
+    return endpoint;
+  }
+  struct sockaddr_in addr {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = static_cast<uint32_t>(packed >> 16);
+  addr.sin_port = static_cast<uint16_t>(packed);
+  Endpoint endpoint;
+  ::memcpy(endpoint.data(), &addr, sizeof(addr));
+  endpoint.resize(sizeof(addr));
+  return endpoint;
+}
+
+} // namespace
+
+bool RateLimiter::allow(size_t &suppressed) {
+  auto now = ch::steady_clock::now();
+  if (now - last < interval) {
+    dropped++;
+    return false;
+  }
+  last = now;
+  suppressed = dropped;
+  dropped = 0;
+  return true;
+}
+
+LoopMonitor::LoopMonitor(const loop_monitor_options &options)
+    : options(options), loop_thread(::syscall(SYS_gettid)) {
+  get_loop_metrics();
+  if (options.watchdog_deadline.count() == 0) {
+    return;
+  }
+  // the first backtrace() loads libgcc, which must not happen in the handler
+  std::array<void *, 1> frame;
+  ::backtrace(frame.data(), frame.size());
+  struct sigaction action {};
+  action.sa_handler = print_backtrace;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  CHECK(sigaction(SIGUSR2, &action, nullptr));
+  watchdog = std::thread([this]() { watch(); });
+}
+
+LoopMonitor::~LoopMonitor() {
+  {
+    std::lock_guard lock{mutex};
+    stop = true;
+  }
+  stop_cv.notify_all();
+  if (watchdog.joinable()) {
+    watchdog.join();
+  }
+}
+
+int64_t LoopMonitor::now_ns() {
+  return ch::duration_cast<ch::nanoseconds>(
+             ch::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void LoopMonitor::begin_iteration() {
+  iteration_start = ch::steady_clock::now();
+  slow_callbacks = 0;
+  busy_since.store(ch::duration_cast<ch::nanoseconds>(
+                       iteration_start.time_since_epoch())
+                       .count(),
+                   std::memory_order_relaxed);
+}
+
+ch::nanoseconds LoopMonitor::end_iteration() {
+  busy_since.store(0, std::memory_order_relaxed);
+  phase.store(nullptr, std::memory_order_relaxed);
+  auto elapsed = ch::steady_clock::now() - iteration_start;
+  if (options.budget.count() && elapsed > options.budget) {
+    get_loop_metrics().stalls.add();
+    size_t suppressed;
+    if (slow_log.allow(suppressed)) {
+      INFO("event loop iteration took {} us, {} slow callbacks ({} slow "
+           "callbacks or iterations not logged)",
+           ch::duration_cast<ch::microseconds>(elapsed).count(),
+           slow_callbacks, suppressed);
+    }
+  }
+  return elapsed;
+}
+
+LoopMonitor::callback_scope
+LoopMonitor::callback(const char *_phase, const Endpoint &_peer) {
+  phase.store(_phase, std::memory_order_relaxed);
+  peer.store(pack_peer(_peer), std::memory_order_relaxed);
+  callback_start = ch::steady_clock::now();
+  return callback_scope(*this);
+}
+
+void LoopMonitor::end_callback() {
+  auto elapsed = ch::steady_clock::now() - callback_start;
+  const char *finished = phase.exchange(nullptr, std::memory_order_relaxed);
+  if (options.budget.count() == 0 || elapsed <= options.budget) {
+    return;
+  }
+  slow_callbacks++;
+  get_loop_metrics().slow_callbacks.add();
+  size_t suppressed;
+  if (slow_log.allow(suppressed)) {
+    INFO("slow {} of {}: {} us ({} slow callbacks or iterations not logged)",
+         finished, unpack_peer(peer.load(std::memory_order_relaxed)),
+         ch::duration_cast<ch::microseconds>(elapsed).count(), suppressed);
+  }
+}
+
+void LoopMonitor::watch() {
+  // an iteration is reported once, however long it takes
+  int64_t reported = 0;
+  auto period = std::max<ch::milliseconds>(options.watchdog_deadline / 4,
+                                           ch::milliseconds(1));
+  std::unique_lock lock{mutex};
+  while (!stop_cv.wait_for(lock, period, [this] { return stop; })) {
+    int64_t since = busy_since.load(std::memory_order_relaxed);
+    if (since == 0 || since == reported) {
+      continue;
+    }
+    auto busy = ch::nanoseconds(now_ns() - since);
+    if (busy < options.watchdog_deadline) {
+      continue;
+    }
+    reported = since;
+    get_loop_metrics().watchdog_dumps.add();
+    const char *current_phase = phase.load(std::memory_order_relaxed);
+    if (current_phase) {
+      ERROR("event loop stuck for {} ms in {} of {}",
+            ch::duration_cast<ch::milliseconds>(busy).count(), current_phase,
+            unpack_peer(peer.load(std::memory_order_relaxed)));
+    } else {
+      ERROR("event loop stuck for {} ms between callbacks",
+            ch::duration_cast<ch::milliseconds>(busy).count());
+    }
+    ::syscall(SYS_tgkill, ::getpid(), loop_thread, SIGUSR2);
+  }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "common.hpp"
+#include "endpoint.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct loop_monitor_options {
+  // iterations and callbacks taking longer are reported, 0 disables it
+  std::chrono::microseconds budget{};
+  // the watchdog dumps a backtrace of the loop once an iteration takes longer,
+  // 0 disables the watchdog
+  std::chrono::milliseconds watchdog_deadline{};
+};
+
+// at most one message per `interval`, the ones in between are counted
+class RateLimiter {
+public:
+  explicit RateLimiter(std::chrono::steady_clock::duration interval)
+      : interval(interval) {}
+
+  // true if a message may be logged now, `suppressed` is set to the number
+  // of messages dropped since the last one
+  bool allow(size_t &suppressed);
+
+private:
+  std::chrono::steady_clock::duration interval;
+  std::chrono::steady_clock::time_point last{};
+  size_t dropped = 0;
+};
+
+// Finds out what blocks an event loop. The loop marks its iterations and the
+// callbacks (phase and peer) within them, iterations and callbacks over the
+// budget are counted (event_loop_* metrics) and logged, rate limited. A
+// watchdog thread checks that a busy loop finishes its iteration within the
+// deadline, otherwise it logs the callback at hand and has the loop thread
+// print its backtrace to stderr (SIGUSR2, function names need -rdynamic, see
+// add_run_target). Waiting in select / epoll_wait between iterations does not
+// count.
+//
+// Construct it on the loop thread.
+class LoopMonitor {
+public:
+  class callback_scope {
+  public:
+    ~callback_scope() { monitor.end_callback(); }
+
+  private:
+    friend class LoopMonitor;
+    explicit callback_scope(LoopMonitor &monitor) : monitor(monitor) {}
+    LoopMonitor &monitor;
+  };
+
+  explicit LoopMonitor(const loop_monitor_options &options);
+  ~LoopMonitor();
+
+  LoopMonitor(const LoopMonitor &) = delete;
+  LoopMonitor &operator=(const LoopMonitor &) = delete;
+
+  // right after select / epoll_wait returned
+  void begin_iteration();
+  // before waiting again, return the duration of the iteration
+  std::chrono::nanoseconds end_iteration();
+
+  // measure a callback until the end of the scope, `phase` is a string
+  // literal
+  [[nodiscard]] callback_scope callback(const char *phase,
+                                        const Endpoint &peer);
+
+private:
+  void end_callback();
+  void watch();
+
+  static int64_t now_ns();
+
+  loop_monitor_options options;
+  pid_t loop_thread;
+
+  std::chrono::steady_clock::time_point iteration_start{};
+  std::chrono::steady_clock::time_point callback_start{};
+  size_t slow_callbacks = 0;
+  RateLimiter slow_log{std::chrono::seconds(1)};
+
+  // shared with the watchdog, the start of the running iteration (0 while
+  // waiting) and the callback at hand, with an IPv4 peer packed as
+  // ip << 16 | port, unix socket peers are not kept (see pack_peer)
+  std::atomic<int64_t> busy_since{0};
+  std::atomic<const char *> phase{nullptr};
+  std::atomic<uint64_t> peer{0};
+
+  std::mutex mutex{};
+  std::condition_variable stop_cv{};
+  bool stop = false;
+  std::thread watchdog{};
+};
@@ -0,0 +1,196 @@
+#include "metrics.hpp"
+#include "trace.hpp"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+MetricsRegistry &MetricsRegistry::instance() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+MetricsRegistry::shard *MetricsRegistry::add_shard() {
+  std::lock_guard lock{mutex};
+  // value initialized, i.e. all zero
+  shards.push_back(std::make_unique<shard>());
+  return shards.back().get();
+}
+
+Counter MetricsRegistry::counter(std::string name, std::string help,
+                                 std::string labels) {
+  std::lock_guard lock{mutex};
+  if (counters.size() == max_counters) {
+    throw program_error("too many counters, can not register {}", name);
+  }
+  counters.push_back({std::move(name), std::move(help), std::move(labels)});
+  return Counter(counters.size() - 1);
+}
+
+Gauge MetricsRegistry::gauge(std::string name, std::string help) {
+  std::lock_guard lock{mutex};
+  if (gauges.size() == max_gauges) {
+    throw program_error("too many gauges, can not register {}", name);
+  }
+  gauges.push_back({std::move(name), std::move(help)});
+  return Gauge(gauges.size() - 1);
+}
+
+size_t MetricsRegistry::add_histogram(description metric) {
+  std::lock_guard lock{mutex};
+  if (histograms.size() == max_histograms) {
+    throw program_error("too many histograms, can not register {}",
+                        metric.name);
+  }
+  histograms.push_back(std::move(metric));
+  return histograms.size() - 1;
+}
+
+TimeHistogram MetricsRegistry::histogram(std::string name, std::string help) {
+  return TimeHistogram(add_histogram(
+      {std::move(name), std::move(help), {}, first_bucket_bits, 1e-9}));
+}
+
+ValueHistogram MetricsRegistry::value_histogram(std::string name,
+                                                std::string help) {
+  return ValueHistogram(
+      add_histogram({std::move(name), std::move(help), {}, 0, 1}));
+}
+
+std::string MetricsRegistry::scrape() const {
+  std::lock_guard lock{mutex};
+  fmt::memory_buffer out;
+  auto header = [&](const description &metric, std::string_view type) {
+    fmt::format_to(std::back_inserter(out), "# HELP {} {}\n# TYPE {} {}\n",
+                   metric.name, metric.help, metric.name, type);
+  };
+  for (size_t i = 0; i < counters.size(); i++) {
+    uint64_t value = 0;
+    for (const auto &s : shards) {
+      value += s->counters[i].load(std::memory_order_relaxed);
+    }
+    const description &counter = counters[i];
+    // once per family
+    if (i == 0 || counters[i - 1].name != counter.name) {
+      header(counter, "counter");
+    }
+    if (counter.labels.empty()) {
+      fmt::format_to(std::back_inserter(out), "{} {}\n", counter.name, value);
+    } else {
+      fmt::format_to(std::back_inserter(out), "{}{{{}}} {}\n", counter.name,
+                     counter.labels, value);
+    }
+  }
+  for (size_t i = 0; i < gauges.size(); i++) {
+    int64_t value = 0;
+    for (const auto &s : shards) {
+      value += s->gauges[i].load(std::memory_order_relaxed);
+    }
+    header(gauges[i], "gauge");
+    fmt::format_to(std::back_inserter(out), "{} {}\n", gauges[i].name, value);
+  }
+  for (size_t i = 0; i < histograms.size(); i++) {
+    std::array<uint64_t, n_buckets> buckets{};
+    uint64_t sum = 0;
+    for (const auto &s : shards) {
+      const auto &histogram = s->histograms[i];
+      for (size_t j = 0; j < n_buckets; j++) {
+        buckets[j] += histogram.buckets[j].load(std::memory_order_relaxed);
+      }
+      sum += histogram.sum.load(std::memory_order_relaxed);
+    }
+    const auto &[name, help, labels, first_bits, scale] = histograms[i];
+    header(histograms[i], "histogram");
+    // buckets are cumulative in the exposition format, the count is derived
+    // from them so that it always equals the +Inf bucket
+    uint64_t count = 0;
+    for (size_t j = 0; j < n_buckets - 1; j++) {
+      count += buckets[j];
+      fmt::format_to(std::back_inserter(out), "{}_bucket{{le=\"{}\"}} {}\n",
+                     name,
+                     static_cast<double>(uint64_t{1} << (first_bits + j)) *
+                         scale,
+                     count);
+    }
+    count += buckets[n_buckets - 1];
+    fmt::format_to(std::back_inserter(out),
+                   "{}_bucket{{le=\"+Inf\"}} {}\n{}_sum {}\n{}_count {}\n",
+                   name, count, name, static_cast<double>(sum) * scale, name,
+                   count);
+  }
+  return fmt::to_string(out);
+}
+
+static SocketOptions admin_socket_options() {
+  SocketOptions options;
+  options.reuse_address = true;
+  return options;
+}
+
+MetricsServer::MetricsServer(std::string_view ip, uint16_t port)
+    : server(ip, port, admin_socket_options()) {
+  server.bind().listen(16);
+  thread = std::thread([this]() { serve(); });
+}
+
+MetricsServer::~MetricsServer() {
+  stopping = true;
+  // wakes up the blocking accept()
+  ::shutdown(server.handle(), SHUT_RDWR);
+  thread.join();
+  ::close(server.handle());
+}
+
+void MetricsServer::serve() {
+  while (!stopping) {
+    Session sess;
+    try {
+      sess = server.accept();
+    } catch (const std::exception &err) {
+      if (!stopping) {
+        ERROR(err.what());
+      }
+      continue;
+    }
+    // a client that never sends its request must not block the next scrape
+    // for long
+    struct timeval timeout {
+      1, 0
+    };
+    setsockopt(sess.handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout,
+               sizeof(timeout));
+    // only the request line matters, read up to the end of the header
+    std::string request;
+    std::array<char, 1024> buffer;
+    while (request.find("\r\n\r\n") == std::string::npos &&
+           request.size() < 8192) {
+      ssize_t n = ::read(sess.handle(), buffer.data(), buffer.size());
+      if (n <= 0) {
+        break;
+      }
+      request.append(buffer.data(), n);
+    }
+    std::string body, content_type;
+    if (request.rfind("GET /trace ", 0) == 0) {
+      body = dump_chrome_trace();
+      content_type = "application/json";
+    } else {
+      body = MetricsRegistry::instance().scrape();
+      content_type = "text/plain; version=0.0.4";
+    }
+    std::string response = fmt::format(
+        "HTTP/1.0 200 OK\r\nContent-Type: {}\r\nContent-Length: {}\r\n"
+        "Connection: close\r\n\r\n{}",
+        content_type, body.size(), body);
+    std::string_view data = response;
+    while (!data.empty()) {
+      ssize_t n =
+          ::send(sess.handle(), data.data(), data.size(), MSG_NOSIGNAL);
+      if (n <= 0) {
+        break;
+      }
+      data.remove_prefix(n);
+    }
+    ::close(sess.handle());
+  }
+}
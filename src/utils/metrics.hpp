@@ -0,0 +1,191 @@
+#pragma once
+
+#include "server.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Process wide metrics in the Prometheus text format. Every thread records
+// into its own cache line aligned shard, a single writer needs plain relaxed
+// loads and stores instead of locked read-modify-writes, and shards are only
+// summed up when scraped, so recording never contends with other threads.
+//
+// Metrics are registered once (keep the returned handles around, e.g. in a
+// static struct), registration throws program_error once the fixed capacity
+// of a shard is used up. Shards of exited threads are kept, so counters never
+// go backwards. Counters of one family share the name and differ in their
+// labels, e.g. `type="depth"`, register them one after another.
+
+class MetricsRegistry;
+
+// monotonic, exported as is, by convention the name ends with `_total`
+class Counter {
+public:
+  void add(uint64_t n = 1) const;
+
+private:
+  friend class MetricsRegistry;
+  explicit Counter(size_t index) : index(index) {}
+  size_t index;
+};
+
+// the exported value is the sum of the values of all threads, set() only
+// replaces the contribution of the calling thread
+class Gauge {
+public:
+  void add(int64_t n) const;
+  void set(int64_t value) const;
+
+private:
+  friend class MetricsRegistry;
+  explicit Gauge(size_t index) : index(index) {}
+  size_t index;
+};
+
+// durations in ns, in power of two buckets from 256 ns to 2^34 ns (~17 s),
+// exported in seconds
+class TimeHistogram {
+public:
+  void record(uint64_t ns) const;
+
+private:
+  friend class MetricsRegistry;
+  explicit TimeHistogram(size_t index) : index(index) {}
+  size_t index;
+};
+
+// sizes and counts, in power of two buckets from 1 to 2^26
+class ValueHistogram {
+public:
+  void record(uint64_t value) const;
+
+private:
+  friend class MetricsRegistry;
+  explicit ValueHistogram(size_t index) : index(index) {}
+  size_t index;
+};
+
+class MetricsRegistry {
+public:
+  static constexpr size_t max_counters = 32;
+  static constexpr size_t max_gauges = 16;
+  static constexpr size_t max_histograms = 16;
+  // upper bound of the first bucket of a TimeHistogram is 2^8 ns, of a
+  // ValueHistogram 2^0
+  static constexpr int first_bucket_bits = 8;
+  // the last bucket is +Inf
+  static constexpr size_t n_buckets = 28;
+
+  struct alignas(64) shard {
+    struct histogram {
+      std::array<std::atomic<uint64_t>, n_buckets> buckets;
+      std::atomic<uint64_t> sum;
+    };
+    std::array<std::atomic<uint64_t>, max_counters> counters;
+    std::array<std::atomic<int64_t>, max_gauges> gauges;
+    std::array<histogram, max_histograms> histograms;
+  };
+
+  static MetricsRegistry &instance();
+
+  Counter counter(std::string name, std::string help, std::string labels = {});
+  Gauge gauge(std::string name, std::string help);
+  TimeHistogram histogram(std::string name, std::string help);
+  ValueHistogram value_histogram(std::string name, std::string help);
+
+  // all metrics in the Prometheus text exposition format (version 0.0.4)
+  std::string scrape() const;
+
+  // shard of the calling thread, created on first use
+  static shard &local() {
+    thread_local shard *s = instance().add_shard();
+    return *s;
+  }
+
+  static size_t bucket_of(uint64_t value, int first_bits = first_bucket_bits) {
+    if (value <= (uint64_t{1} << first_bits)) {
+      return 0;
+    }
+    size_t bucket = 64 - __builtin_clzll(value - 1) - first_bits;
+    return bucket < n_buckets - 1 ? bucket : n_buckets - 1;
+  }
+
+private:
+  struct description {
+    std::string name;
+    std::string help;
+    // counters only, `key="value",...` without braces
+    std::string labels{};
+    // histograms only, the exported bounds are 2^(first_bits + i) * scale
+    int first_bits = 0;
+    double scale = 1;
+  };
+
+  MetricsRegistry() = default;
+  shard *add_shard();
+  size_t add_histogram(description metric);
+
+  mutable std::mutex mutex{};
+  std::vector<std::unique_ptr<shard>> shards{};
+  std::vector<description> counters{};
+  std::vector<description> gauges{};
+  std::vector<description> histograms{};
+};
+
+// only the owning thread writes a slot
+template <typename T> inline void add_relaxed(std::atomic<T> &slot, T n) {
+  slot.store(slot.load(std::memory_order_relaxed) + n,
+             std::memory_order_relaxed);
+}
+
+inline void Counter::add(uint64_t n) const {
+  add_relaxed(MetricsRegistry::local().counters[index], n);
+}
+
+inline void Gauge::add(int64_t n) const {
+  add_relaxed(MetricsRegistry::local().gauges[index], n);
+}
+
+inline void Gauge::set(int64_t value) const {
+  MetricsRegistry::local().gauges[index].store(value,
+                                               std::memory_order_relaxed);
+}
+
+inline void TimeHistogram::record(uint64_t ns) const {
+  auto &histogram = MetricsRegistry::local().histograms[index];
+  add_relaxed(histogram.buckets[MetricsRegistry::bucket_of(ns)], uint64_t{1});
+  add_relaxed(histogram.sum, ns);
+}
+
+inline void ValueHistogram::record(uint64_t value) const {
+  auto &histogram = MetricsRegistry::local().histograms[index];
+  add_relaxed(histogram.buckets[MetricsRegistry::bucket_of(value, 0)],
+              uint64_t{1});
+  add_relaxed(histogram.sum, value);
+}
+
+// Serves MetricsRegistry::scrape() over HTTP from its own thread and
+// listening socket (an admin port), so scrapes stay away from the event loop.
+// `GET /trace` is answered with dump_chrome_trace(), any other request with
+// all metrics.
+class MetricsServer {
+public:
+  MetricsServer(std::string_view ip, uint16_t port);
+  ~MetricsServer();
+
+  MetricsServer(const MetricsServer &) = delete;
+  MetricsServer &operator=(const MetricsServer &) = delete;
+
+private:
+  void serve();
+
+  Server server;
+  std::atomic<bool> stopping{false};
+  std::thread thread{};
+};
@@ -0,0 +1,196 @@
+#include "proc_stats.hpp"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+std::map<std::string, uint64_t> read_tcp_ext_counters() {
+  std::ifstream file("/proc/net/netstat");
+  if (!file) {
+    THROW("failed to open /proc/net/netstat");
+  }
+  // pairs of lines, the first holding the names and the second the values
+  std::map<std::string, uint64_t> counters;
+  std::string names, values;
+  while (std::getline(file, names) && std::getline(file, values)) {
+    if (names.rfind("TcpExt:", 0) != 0) {
+      continue;
+    }
+    std::istringstream name_stream(names), value_stream(values);
+    std::string name, prefix;
+    uint64_t value;
+    name_stream >> prefix;
+    value_stream >> prefix;
+    while (name_stream >> name && value_stream >> value) {
+      counters[name] = value;
+    }
+  }
+  return counters;
+}
+
+size_t read_time_wait_count() {
+  std::ifstream file("/proc/net/sockstat");
+  if (!file) {
+    THROW("failed to open /proc/net/sockstat");
+  }
+  // TCP: inuse 5 orphan 0 tw 0 alloc 5 mem 0
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.rfind("TCP:", 0) != 0) {
+      continue;
+    }
+    std::istringstream stream(line.substr(4));
+    std::string key;
+    size_t value;
+    while (stream >> key >> value) {
+      if (key == "tw") {
+        return value;
+      }
+    }
+  }
+  return 0;
+}
+
+// `op(a, b)` of two counts, unknown if one of them is
+template <typename Op>
+static std::optional<uint64_t> combine(const std::optional<uint64_t> &a,
+                                       const std::optional<uint64_t> &b,
+                                       Op op) {
+  if (!a || !b) {
+    return std::nullopt;
+  }
+  return op(*a, *b);
+}
+
+process_stats process_stats::operator+(const process_stats &other) const {
+  return {user_time + other.user_time,
+          system_time + other.system_time,
+          voluntary_switches + other.voluntary_switches,
+          involuntary_switches + other.involuntary_switches,
+          combine(read_syscalls, other.read_syscalls, std::plus<>{}),
+          combine(write_syscalls, other.write_syscalls, std::plus<>{})};
+}
+
+process_stats process_stats::operator-(const process_stats &other) const {
+  return {user_time - other.user_time,
+          system_time - other.system_time,
+          voluntary_switches - other.voluntary_switches,
+          involuntary_switches - other.involuntary_switches,
+          combine(read_syscalls, other.read_syscalls, std::minus<>{}),
+          combine(write_syscalls, other.write_syscalls, std::minus<>{})};
+}
+
+// `key: value` lines of /proc/<pid>/status and io
+static std::map<std::string, uint64_t> read_key_values(const std::string &path) {
+  std::ifstream file(path);
+  std::map<std::string, uint64_t> values;
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    std::istringstream stream(line.substr(colon + 1));
+    uint64_t value;
+    if (stream >> value) {
+      values[line.substr(0, colon)] = value;
+    }
+  }
+  return values;
+}
+
+process_stats read_process_stats(pid_t pid) {
+  std::string dir = fmt::format("/proc/{}", pid);
+  std::ifstream file(dir + "/stat");
+  std::string stat;
+  if (!std::getline(file, stat)) {
+    THROW("failed to read {}/stat", dir);
+  }
+  // the command name in parentheses may contain spaces, the fields after it
+  // start with the state (field 3), utime and stime are fields 14 and 15
+  std::istringstream stream(stat.substr(stat.rfind(')') + 1));
+  std::string field;
+  uint64_t utime = 0, stime = 0;
+  for (int i = 3; i <= 15 && stream >> field; i++) {
+    if (i == 14) {
+      utime = std::stoull(field);
+    } else if (i == 15) {
+      stime = std::stoull(field);
+    }
+  }
+  static const double ticks = ::sysconf(_SC_CLK_TCK);
+  process_stats stats;
+  stats.user_time = utime / ticks;
+  stats.system_time = stime / ticks;
+  auto status = read_key_values(dir + "/status");
+  stats.voluntary_switches = status["voluntary_ctxt_switches"];
+  stats.involuntary_switches = status["nonvoluntary_ctxt_switches"];
+  // io needs ptrace access, the counts stay unknown without it
+  auto io = read_key_values(dir + "/io");
+  if (io.count("syscr") && io.count("syscw")) {
+    stats.read_syscalls = io["syscr"];
+    stats.write_syscalls = io["syscw"];
+  }
+  return stats;
+}
+
+PerfCounters::PerfCounters(pid_t pid) {
+  constexpr std::array<uint64_t, 3> configs{PERF_COUNT_HW_INSTRUCTIONS,
+                                            PERF_COUNT_HW_CPU_CYCLES,
+                                            PERF_COUNT_HW_CACHE_MISSES};
+  for (size_t i = 0; i < configs.size(); i++) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[i];
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    int fd = ::syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0);
+    if (fd == -1) {
+      INFO("perf counters of process {} unavailable: {}", pid,
+           get_errno_string(errno));
+      for (int &opened : fds) {
+        if (opened != -1) {
+          ::close(opened);
+          opened = -1;
+        }
+      }
+      return;
+    }
+    fds[i] = fd;
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  for (int fd : fds) {
+    if (fd != -1) {
+      ::close(fd);
+    }
+  }
+}
+
+void PerfCounters::start() {
+  for (int fd : fds) {
+    if (fd != -1) {
+      CHECK(::ioctl(fd, PERF_EVENT_IOC_RESET, 0));
+      CHECK(::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0));
+    }
+  }
+}
+
+PerfCounters::counts PerfCounters::stop() {
+  std::array<uint64_t, 3> values{};
+  for (size_t i = 0; i < fds.size(); i++) {
+    if (fds[i] != -1) {
+      CHECK(::ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0));
+      CHECK(::read(fds[i], &values[i], sizeof(values[i])));
+    }
+  }
+  return {values[0], values[1], values[2]};
+}
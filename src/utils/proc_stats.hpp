@@ -0,0 +1,77 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <sys/types.h>
+
+#include <array>
+#include <map>
+#include <optional>
+#include <string>
+
+// system wide network counters of the current network namespace, read from
+// procfs
+
+// the `TcpExt` counters of /proc/net/netstat, e.g. ListenOverflows (SYNs or
+// completed handshakes dropped because the accept queue was full)
+std::map<std::string, uint64_t> read_tcp_ext_counters();
+
+// number of TCP sockets in TIME_WAIT, from /proc/net/sockstat
+size_t read_time_wait_count();
+
+// resource usage of a process (all of its threads) so far, from
+// /proc/<pid>/stat, status and io. getrusage(2) only covers the calling
+// process and its waited for children, this works for any process we may
+// ptrace. The syscall counts only cover read and write like system calls,
+// they are unknown if /proc/<pid>/io is not readable (it needs ptrace access).
+struct process_stats {
+  double user_time{};
+  double system_time{};
+  uint64_t voluntary_switches{};
+  uint64_t involuntary_switches{};
+  std::optional<uint64_t> read_syscalls{};
+  std::optional<uint64_t> write_syscalls{};
+
+  double cpu_time() const { return user_time + system_time; }
+  std::optional<uint64_t> syscalls() const {
+    if (!read_syscalls || !write_syscalls) {
+      return std::nullopt;
+    }
+    return *read_syscalls + *write_syscalls;
+  }
+  // the syscall counts of the result are unknown if they are unknown on
+  // either side
+  process_stats operator+(const process_stats &other) const;
+  process_stats operator-(const process_stats &other) const;
+};
+
+process_stats read_process_stats(pid_t pid);
+
+// Hardware counters of a process with perf_event_open(2). Threads created
+// after the counters are opened are counted as well, existing ones other
+// than the main thread are not. Opening fails without the permission to
+// profile the process (see /proc/sys/kernel/perf_event_paranoid), the
+// counters are unavailable then.
+class PerfCounters {
+public:
+  struct counts {
+    uint64_t instructions{};
+    uint64_t cycles{};
+    uint64_t cache_misses{};
+  };
+
+  explicit PerfCounters(pid_t pid);
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  bool available() const { return fds[0] != -1; }
+  // reset and enable the counters
+  void start();
+  // disable the counters and read them
+  counts stop();
+
+private:
+  std::array<int, 3> fds{-1, -1, -1};
+};
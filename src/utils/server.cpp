@@ -1,26 +1,39 @@
 #include "server.hpp"
 #include "utils/common.hpp"
 
+#include <linux/sockios.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
 void Server::create_socket() {
-  CHECK(fd_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+  CHECK(fd_ = ::socket(local_endpoint_.family(), SOCK_STREAM, 0));
+  options_.apply_listener(fd_, local_endpoint_.family());
 }
 
-Server::Server(std::string_view ip, uint16_t port) {
-  local_endpoint_.sin_family = AF_INET;
-  local_endpoint_.sin_port = ::htons(port);
-  set_addr(local_endpoint_, ip);
+Server::Server(const Endpoint &endpoint, const SocketOptions &options)
+    : local_endpoint_(endpoint), options_(options) {
   create_socket();
 }
 
-Server::Server(uint16_t port) {
-  local_endpoint_.sin_family = AF_INET;
-  local_endpoint_.sin_port = ::htons(port);
-  local_endpoint_.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
-  create_socket();
-}
+Server::Server(std::string_view ip, uint16_t port,
+               const SocketOptions &options)
+    : Server(Endpoint{ip, port}, options) {}
+
+Server::Server(uint16_t port, const SocketOptions &options)
+    : Server(Endpoint{port}, options) {}
 
 Server &Server::bind() {
-  CHECK(::bind(fd_, SOCKADDR(local_endpoint_), sizeof(local_endpoint_)));
+  if (local_endpoint_.is_unix()) {
+    // left behind by a previous run, only remove sockets, never other files
+    std::string path = local_endpoint_.path();
+    struct stat status {};
+    if (path[0] != '@' && ::stat(path.c_str(), &status) == 0 &&
+        S_ISSOCK(status.st_mode)) {
+      CHECK(::unlink(path.c_str()));
+    }
+  }
+  CHECK(::bind(fd_, local_endpoint_.data(), local_endpoint_.size()));
   return *this;
 }
 
@@ -32,8 +45,8 @@ Server &Server::listen(int backlog_size) {
 
 Session Server::accept() {
   Session sess = Session();
-  socklen_t size = sizeof(sess.remote_endpoint_);
-  sess.fd_ = ::accept(fd_, SOCKADDR(sess.remote_endpoint_), &size);
+  socklen_t size = Endpoint::capacity();
+  sess.fd_ = ::accept(fd_, sess.remote_endpoint_.data(), &size);
   if (sess.fd_ == -1) {
     int _errno = errno;
     if (would_block(_errno) || _errno == EINPROGRESS) {
@@ -41,7 +54,37 @@ Session Server::accept() {
     }
     THROW(get_errno_string(_errno));
   }
-  ::memcpy(&sess.local_endpoint_, &local_endpoint_, sizeof(local_endpoint_));
+  sess.remote_endpoint_.resize(size);
+  sess.local_endpoint_ = local_endpoint_;
+  try {
+    options_.apply_connection(sess.fd_, local_endpoint_.family());
+  } catch (...) {
+    ::close(sess.fd_);
+    throw;
+  }
   DEBUG("accept connection from {}", sess.remote_endpoint_);
   return sess;
-}
\ No newline at end of file
+}
+
+tcp_info_sample Session::tcp_info() const {
+  struct tcp_info info {};
+  socklen_t size = sizeof(info);
+  CHECK(::getsockopt(fd_, IPPROTO_TCP, TCP_INFO, &info, &size));
+  int send_queue_bytes;
+  CHECK(::ioctl(fd_, SIOCOUTQ, &send_queue_bytes));
+  return {info.tcpi_rtt, info.tcpi_rttvar, info.tcpi_total_retrans,
+          info.tcpi_unacked, static_cast<uint32_t>(send_queue_bytes)};
+}
+
+std::ostream &operator<<(std::ostream &os, const tcp_info_sample &sample) {
+  return os << fmt::format("rtt: {} us, rttvar: {} us, retransmits: {}, "
+                           "unacked: {}, send queue: {} bytes",
+                           sample.rtt_us, sample.rttvar_us, sample.retransmits,
+                           sample.unacked, sample.send_queue_bytes);
+}
+
+std::ostream &operator<<(std::ostream &os, const Session &session) {
+  return os << fmt::format("fd {}, {} -> {}", session.handle(),
+                           session.remote_endpoint(),
+                           session.local_endpoint());
+}
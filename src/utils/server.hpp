@@ -1,17 +1,38 @@
 #pragma once
 
 #include "common.hpp"
+#include "endpoint.hpp"
 #include "exceptions.hpp"
+#include "socket_options.hpp"
 
 #include <arpa/inet.h>
 #include <functional>
 
+// the kernel's view of a TCP connection, from TCP_INFO (see tcp(7)) and
+// SIOCOUTQ
+struct tcp_info_sample {
+  uint32_t rtt_us{};
+  uint32_t rttvar_us{};
+  // retransmitted segments over the lifetime of the connection
+  uint32_t retransmits{};
+  // segments sent but not acknowledged yet
+  uint32_t unacked{};
+  // bytes in the send queue, not sent or not acknowledged yet
+  uint32_t send_queue_bytes{};
+};
+
+std::ostream &operator<<(std::ostream &os, const tcp_info_sample &sample);
+
+template <> struct fmt::formatter<tcp_info_sample> : ostream_formatter {};
+
 class Session {
 public:
   Session() = default;
   int handle() const { return fd_; }
-  const struct sockaddr_in &remote_endpoint() { return remote_endpoint_; }
-  const struct sockaddr_in &local_endpoint() { return local_endpoint_; }
+  const Endpoint &remote_endpoint() const { return remote_endpoint_; }
+  const Endpoint &local_endpoint() const { return local_endpoint_; }
+  // throw program_error if the socket is not a TCP socket
+  tcp_info_sample tcp_info() const;
 
   friend class Server;
   friend struct std::hash<Session>;
@@ -22,10 +43,15 @@ public:
 
 protected:
   int fd_{};
-  struct sockaddr_in remote_endpoint_ {};
-  struct sockaddr_in local_endpoint_ {};
+  Endpoint remote_endpoint_{};
+  Endpoint local_endpoint_{};
 };
 
+// fd and endpoints, for debug logs
+std::ostream &operator<<(std::ostream &os, const Session &session);
+
+template <> struct fmt::formatter<Session> : ostream_formatter {};
+
 namespace std {
 template <> struct hash<Session> {
   size_t operator()(const Session &s) const noexcept {
@@ -36,16 +62,21 @@ template <> struct hash<Session> {
 
 class Server {
 public:
-  Server(std::string_view ip, uint16_t port);
+  // a stale socket file of a unix endpoint is removed by bind(), the file is
+  // left behind at exit
+  Server(const Endpoint &endpoint, const SocketOptions &options = {});
+
+  Server(std::string_view ip, uint16_t port,
+         const SocketOptions &options = {});
 
-  Server(uint16_t port);
+  Server(uint16_t port, const SocketOptions &options = {});
 
   Server &bind();
   Server &listen(int backlog_size);
 
   int handle() const { return fd_; }
 
-  const struct sockaddr_in &local_endpoint() const { return local_endpoint_; }
+  const Endpoint &local_endpoint() const { return local_endpoint_; }
 
   Session accept();
 
@@ -54,5 +85,7 @@ private:
 
 private:
   int fd_{};
-  struct sockaddr_in local_endpoint_ {};
+  Endpoint local_endpoint_{};
+  // applied to every accepted session
+  SocketOptions options_{};
 };
\ No newline at end of file
@@ -0,0 +1,316 @@
+#include "shm_channel.hpp"
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <utility>
+
+// written by one end each, on separate cache lines
+struct ShmChannel::ring {
+  // bytes ever written, by the producer
+  alignas(64) std::atomic<uint64_t> head;
+  // bytes ever read, by the consumer
+  alignas(64) std::atomic<uint64_t> tail;
+  // the consumer waits for data
+  alignas(64) std::atomic<bool> reader_waiting;
+  // the producer waits for space
+  alignas(64) std::atomic<bool> writer_waiting;
+};
+
+// start of the memfd, the data of rings[0] and rings[1] follow
+struct ShmChannel::shared {
+  uint64_t ring_size;
+  // per end, set once it closed its end
+  std::atomic<bool> closed[2];
+  ring rings[2];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<bool>::is_always_lock_free,
+              "atomics in shared memory must be lock free");
+
+namespace {
+
+// the message of the handshake, next to the fds
+struct handshake {
+  static constexpr uint64_t expected_magic = 0x63616c632d73686d; // "calc-shm"
+  uint64_t magic;
+  uint64_t ring_size;
+};
+
+// the memfd, the doorbell of the client and the one of the server
+constexpr size_t n_handshake_fds = 3;
+
+void send_fds(int sock_fd, const handshake &message,
+              const std::array<int, n_handshake_fds> &fds) {
+  iovec iov{const_cast<handshake *>(&message), sizeof(message)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  ::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(fds));
+  CHECK(::sendmsg(sock_fd, &msg, MSG_NOSIGNAL));
+}
+
+// std::nullopt if `wait` is not set and nothing arrived yet
+std::optional<handshake> receive_fds(int sock_fd,
+                                     std::array<int, n_handshake_fds> &fds,
+                                     bool wait) {
+  handshake message{};
+  iovec iov{&message, sizeof(message)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  if (wait) {
+    // a server without --transport shm waits for requests instead
+    timeval timeout{5, 0};
+    CHECK(::setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                       sizeof(timeout)));
+  }
+  ssize_t bytes = ::recvmsg(sock_fd, &msg,
+                            MSG_CMSG_CLOEXEC | (wait ? 0 : MSG_DONTWAIT));
+  if (bytes == -1 && would_block(errno)) {
+    if (!wait) {
+      return std::nullopt;
+    }
+    bytes = 0;
+  } else if (bytes == -1) {
+    THROW(get_errno_string(errno));
+  }
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (bytes == 0 || cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+    THROW("no shared memory channel received, is the server started with "
+          "--transport shm?");
+  }
+  ::memcpy(fds.data(), CMSG_DATA(cmsg), sizeof(fds));
+  if (bytes != sizeof(message) || message.magic != handshake::expected_magic ||
+      (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+    for (int fd : fds) {
+      ::close(fd);
+    }
+    THROW("invalid shared memory channel handshake");
+  }
+  return message;
+}
+
+} // namespace
+
+ShmChannel ShmChannel::accept(int sock_fd, size_t ring_size) {
+  if (ring_size == 0 || (ring_size & (ring_size - 1)) != 0) {
+    THROW("shared memory ring size {} is not a power of two", ring_size);
+  }
+  ShmChannel channel;
+  channel.ring_size = ring_size;
+  channel.memory_size = sizeof(shared) + 2 * ring_size;
+  int memfd;
+  CHECK(memfd = ::memfd_create("calculator-shm", MFD_CLOEXEC));
+  try {
+    CHECK(::ftruncate(memfd, channel.memory_size));
+    void *address = ::mmap(nullptr, channel.memory_size,
+                           PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (address == MAP_FAILED) {
+      THROW(get_errno_string(errno));
+    }
+    channel.memory = new (address) shared{};
+    channel.memory->ring_size = ring_size;
+    CHECK(channel.doorbell = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    CHECK(channel.peer_doorbell = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    send_fds(sock_fd, {handshake::expected_magic, ring_size},
+             {memfd, channel.peer_doorbell, channel.doorbell});
+  } catch (...) {
+    ::close(memfd);
+    throw;
+  }
+  ::close(memfd);
+  return channel;
+}
+
+ShmChannel ShmChannel::connect(int sock_fd) {
+  std::array<int, n_handshake_fds> fds;
+  handshake message = *receive_fds(sock_fd, fds, true);
+  return attach(message.ring_size, fds[0], fds[1], fds[2]);
+}
+
+std::optional<ShmChannel> ShmChannel::try_connect(int sock_fd) {
+  std::array<int, n_handshake_fds> fds;
+  std::optional<handshake> message = receive_fds(sock_fd, fds, false);
+  if (!message) {
+    return std::nullopt;
+  }
+  return attach(message->ring_size, fds[0], fds[1], fds[2]);
+}
+
+ShmChannel ShmChannel::attach(size_t ring_size, int memfd, int doorbell,
+                              int peer_doorbell) {
+  ShmChannel channel;
+  channel.side = 1;
+  channel.ring_size = ring_size;
+  channel.doorbell = doorbell;
+  channel.peer_doorbell = peer_doorbell;
+  try {
+    struct stat status {};
+    CHECK(::fstat(memfd, &status));
+    channel.memory_size = sizeof(shared) + 2 * ring_size;
+    if (static_cast<size_t>(status.st_size) != channel.memory_size) {
+      THROW("shared memory of {} bytes does not hold rings of {} bytes",
+            status.st_size, ring_size);
+    }
+    void *address = ::mmap(nullptr, channel.memory_size,
+                           PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (address == MAP_FAILED) {
+      THROW(get_errno_string(errno));
+    }
+    channel.memory = static_cast<shared *>(address);
+  } catch (...) {
+    ::close(memfd);
+    throw;
+  }
+  ::close(memfd);
+  return channel;
+}
+
+ShmChannel::ShmChannel(ShmChannel &&other) noexcept {
+  *this = std::move(other);
+}
+
+ShmChannel &ShmChannel::operator=(ShmChannel &&other) noexcept {
+  if (this != &other) {
+    close();
+    memory = std::exchange(other.memory, nullptr);
+    memory_size = std::exchange(other.memory_size, 0);
+    ring_size = std::exchange(other.ring_size, 0);
+    side = other.side;
+    doorbell = std::exchange(other.doorbell, -1);
+    peer_doorbell = std::exchange(other.peer_doorbell, -1);
+  }
+  return *this;
+}
+
+ShmChannel::~ShmChannel() { close(); }
+
+void ShmChannel::close() {
+  if (memory) {
+    memory->closed[side].store(true, std::memory_order_release);
+    // whatever the peer waits for, it learns that we are gone
+    ring_peer();
+    ::munmap(memory, memory_size);
+    memory = nullptr;
+  }
+  if (doorbell != -1) {
+    ::close(doorbell);
+    doorbell = -1;
+  }
+  if (peer_doorbell != -1) {
+    ::close(peer_doorbell);
+    peer_doorbell = -1;
+  }
+}
+
+char *ShmChannel::ring_data(int index) const {
+  return reinterpret_cast<char *>(memory + 1) + index * ring_size;
+}
+
+void ShmChannel::ring_peer() {
+  uint64_t one = 1;
+  // only fails if the counter would overflow, it is readable then anyway
+  ssize_t ignored = ::write(peer_doorbell, &one, sizeof(one));
+  (void)ignored;
+}
+
+// callers read after the doorbell fired, so this syscall is rarely in vain. a
+// flag telling whether the doorbell was rung would race with the write of the
+// peer and leave the doorbell readable with nothing to do
+void ShmChannel::drain() {
+  uint64_t count;
+  // EAGAIN if it was not rung
+  ssize_t ignored = ::read(doorbell, &count, sizeof(count));
+  (void)ignored;
+}
+
+// The waiting flags follow the store -> fence -> load pattern on both ends: a
+// waiter sets its flag and checks the ring again, the other end publishes and
+// checks the flag, so at least one of them sees the other.
+
+ssize_t ShmChannel::write(const char *data, size_t size) {
+  if (memory->closed[1 - side].load(std::memory_order_acquire)) {
+    errno = EPIPE;
+    return -1;
+  }
+  ring &tx = memory->rings[side];
+  uint64_t head = tx.head.load(std::memory_order_relaxed);
+  uint64_t free = ring_size - (head - tx.tail.load(std::memory_order_acquire));
+  if (free == 0) {
+    tx.writer_waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    free = ring_size - (head - tx.tail.load(std::memory_order_acquire));
+    if (free == 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+    tx.writer_waiting.store(false, std::memory_order_relaxed);
+  }
+  size_t n = std::min<uint64_t>(size, free);
+  size_t offset = head & (ring_size - 1);
+  size_t first = std::min(n, ring_size - offset);
+  ::memcpy(ring_data(side) + offset, data, first);
+  ::memcpy(ring_data(side), data + first, n - first);
+  tx.head.store(head + n, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (tx.reader_waiting.load(std::memory_order_relaxed) &&
+      tx.reader_waiting.exchange(false, std::memory_order_relaxed)) {
+    ring_peer();
+  }
+  return n;
+}
+
+ssize_t ShmChannel::read(char *data, size_t size) {
+  ring &rx = memory->rings[1 - side];
+  uint64_t tail = rx.tail.load(std::memory_order_relaxed);
+  uint64_t head = rx.head.load(std::memory_order_acquire);
+  if (head == tail) {
+    // about to wait, a count left in the doorbell would wake us at once
+    drain();
+    rx.reader_waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    head = rx.head.load(std::memory_order_acquire);
+    if (head == tail) {
+      if (memory->closed[1 - side].load(std::memory_order_acquire) &&
+          rx.head.load(std::memory_order_acquire) == tail) {
+        return 0;
+      }
+      errno = EAGAIN;
+      return -1;
+    }
+    rx.reader_waiting.store(false, std::memory_order_relaxed);
+  }
+  size_t n = std::min<uint64_t>(size, head - tail);
+  size_t offset = tail & (ring_size - 1);
+  size_t first = std::min(n, ring_size - offset);
+  ::memcpy(data, ring_data(1 - side) + offset, first);
+  ::memcpy(data + first, ring_data(1 - side), n - first);
+  rx.tail.store(tail + n, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (rx.writer_waiting.load(std::memory_order_relaxed) &&
+      rx.writer_waiting.exchange(false, std::memory_order_relaxed)) {
+    ring_peer();
+  }
+  return n;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <optional>
+
+// One end of a same-host transport without sockets: a pair of lock-free single
+// producer / single consumer byte rings in a memfd shared by the server and a
+// client, carrying the same frames as a socket would. Each end owns an eventfd
+// doorbell, rung by the peer only when it published data or freed space while
+// this end was waiting for it, so there is no syscall at all while both ends
+// are busy.
+//
+// The server creates the memfd and both eventfds once it accepted a unix
+// socket, and passes them to the client with SCM_RIGHTS, see accept() and
+// connect(). The unix socket is not used afterwards, except that it reports
+// EOF when the peer is gone.
+//
+// read() and write() behave like ::read and ::write on a non-blocking socket
+// (-1 with EAGAIN, read() returns 0 once the peer closed its end and the ring
+// is empty), ShmChannel is a Stream of Connection. handle() is readable when
+// data arrived or space was freed: after it fired, try to read and then to
+// write before waiting again.
+class ShmChannel {
+public:
+  static constexpr size_t default_ring_size = 1 << 16;
+
+  ShmChannel() = default;
+  ~ShmChannel();
+
+  ShmChannel(ShmChannel &&other) noexcept;
+  ShmChannel &operator=(ShmChannel &&other) noexcept;
+  ShmChannel(const ShmChannel &) = delete;
+  ShmChannel &operator=(const ShmChannel &) = delete;
+
+  // server end on the accepted unix socket `sock_fd`, with rings of
+  // `ring_size` bytes (a power of two) per direction
+  static ShmChannel accept(int sock_fd, size_t ring_size = default_ring_size);
+  // client end on the connected unix socket `sock_fd`, block until the server
+  // passed the channel, 5 s at most
+  static ShmChannel connect(int sock_fd);
+  // same as connect() on a non-blocking `sock_fd`, std::nullopt if the channel
+  // did not arrive yet, i.e. wait for `sock_fd` to turn readable and retry
+  static std::optional<ShmChannel> try_connect(int sock_fd);
+
+  int handle() const { return doorbell; }
+  ssize_t read(char *data, size_t size);
+  ssize_t write(const char *data, size_t size);
+
+private:
+  struct ring;
+  struct shared;
+
+  // client end on the received memfd and doorbells, takes all three fds,
+  // `memfd` is closed once mapped (or on failure)
+  static ShmChannel attach(size_t ring_size, int memfd, int doorbell,
+                           int peer_doorbell);
+
+  char *ring_data(int index) const;
+  void ring_peer();
+  void drain();
+  void close();
+
+  shared *memory = nullptr;
+  size_t memory_size = 0;
+  size_t ring_size = 0;
+  // 0 on the server, 1 on the client, this end writes into rings[side]
+  int side = 0;
+  int doorbell = -1;
+  int peer_doorbell = -1;
+};
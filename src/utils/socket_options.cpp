@@ -0,0 +1,102 @@
+#include "socket_options.hpp"
+
+#include <netinet/tcp.h>
+
+#include <vector>
+
+SocketOptions SocketOptions::preset(std::string_view name) {
+  SocketOptions options;
+  if (name == "default") {
+  } else if (name == "low-latency") {
+    options.no_delay = true;
+    options.quick_ack = true;
+  } else if (name == "throughput") {
+    options.send_buffer = 4 << 20;
+    options.receive_buffer = 4 << 20;
+  } else {
+    throw program_error("unknown socket options preset {}, expect default, "
+                        "low-latency or throughput",
+                        name);
+  }
+  return options;
+}
+
+static void set_int_option(int fd, int level, int name, int value) {
+  CHECK(setsockopt(fd, level, name, &value, sizeof(value)));
+}
+
+void SocketOptions::apply_listener(int fd, int family) const {
+  bool inet = family == AF_INET;
+  if (reuse_address && inet) {
+    set_int_option(fd, SOL_SOCKET, SO_REUSEADDR, 1);
+  }
+  if (reuse_port && inet) {
+    set_int_option(fd, SOL_SOCKET, SO_REUSEPORT, 1);
+  }
+  // the window scale is negotiated before accept(), the receive buffer of
+  // accepted sockets must be known by then
+  if (send_buffer) {
+    set_int_option(fd, SOL_SOCKET, SO_SNDBUF, *send_buffer);
+  }
+  if (receive_buffer) {
+    set_int_option(fd, SOL_SOCKET, SO_RCVBUF, *receive_buffer);
+  }
+}
+
+void SocketOptions::apply_connection(int fd, int family) const {
+  if (family == AF_INET) {
+    if (no_delay) {
+      set_int_option(fd, IPPROTO_TCP, TCP_NODELAY, *no_delay);
+    }
+    if (quick_ack) {
+      set_int_option(fd, IPPROTO_TCP, TCP_QUICKACK, *quick_ack);
+    }
+    if (cork) {
+      set_int_option(fd, IPPROTO_TCP, TCP_CORK, *cork);
+    }
+  }
+  if (send_buffer) {
+    set_int_option(fd, SOL_SOCKET, SO_SNDBUF, *send_buffer);
+  }
+  if (receive_buffer) {
+    set_int_option(fd, SOL_SOCKET, SO_RCVBUF, *receive_buffer);
+  }
+  if (keep_alive && family == AF_INET) {
+    set_int_option(fd, SOL_SOCKET, SO_KEEPALIVE, *keep_alive);
+  }
+  if (linger) {
+    struct linger linger_opt {};
+    linger_opt.l_onoff = 1;
+    linger_opt.l_linger = *linger;
+    CHECK(setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger_opt,
+                     sizeof(linger_opt)));
+  }
+}
+
+std::ostream &operator<<(std::ostream &os, const SocketOptions &options) {
+  std::vector<std::string> set;
+  auto flag = [&](std::string_view name, const std::optional<bool> &value) {
+    if (value) {
+      set.push_back(fmt::format("{}={}", name, *value ? "on" : "off"));
+    }
+  };
+  auto number = [&](std::string_view name, const std::optional<int> &value) {
+    if (value) {
+      set.push_back(fmt::format("{}={}", name, *value));
+    }
+  };
+  flag("reuse_address", options.reuse_address ? std::optional(true)
+                                              : std::nullopt);
+  flag("reuse_port", options.reuse_port ? std::optional(true) : std::nullopt);
+  flag("no_delay", options.no_delay);
+  flag("quick_ack", options.quick_ack);
+  flag("cork", options.cork);
+  number("send_buffer", options.send_buffer);
+  number("receive_buffer", options.receive_buffer);
+  flag("keep_alive", options.keep_alive);
+  number("linger", options.linger);
+  if (set.empty()) {
+    return os << "system defaults";
+  }
+  return os << fmt::format("{}", fmt::join(set, ", "));
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <optional>
+#include <string_view>
+
+// Declarative socket options, applied by Server (to the listener before
+// bind() and to every accepted Session) and by Client (before connect(), so
+// that the buffer sizes take part in the window scale negotiation). Options
+// left empty keep the system defaults. Unix domain sockets only take the
+// buffer sizes and SO_LINGER, the other options are skipped for them.
+struct SocketOptions {
+  // listener only
+  bool reuse_address{};
+  bool reuse_port{};
+
+  // TCP_NODELAY, send small segments at once instead of coalescing them
+  std::optional<bool> no_delay{};
+  // TCP_QUICKACK, only a hint, the kernel falls back to delayed acks on its
+  // own
+  std::optional<bool> quick_ack{};
+  // TCP_CORK, hold partial segments until uncorked or for 200 ms at most
+  std::optional<bool> cork{};
+  // SO_SNDBUF / SO_RCVBUF in bytes, the kernel doubles them
+  std::optional<int> send_buffer{};
+  std::optional<int> receive_buffer{};
+  std::optional<bool> keep_alive{};
+  // SO_LINGER timeout in seconds, 0 resets the connection on close()
+  std::optional<int> linger{};
+
+  // "default": nothing set; "low-latency": TCP_NODELAY and TCP_QUICKACK;
+  // "throughput": 4 MiB socket buffers. Throw program_error for other names
+  static SocketOptions preset(std::string_view name);
+
+  // `family` of the socket, AF_INET or AF_UNIX
+  void apply_listener(int fd, int family) const;
+  void apply_connection(int fd, int family) const;
+};
+
+std::ostream &operator<<(std::ostream &os, const SocketOptions &options);
+
+template <> struct fmt::formatter<SocketOptions> : ostream_formatter {};
@@ -0,0 +1,35 @@
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(size_t n_threads) {
+  workers.reserve(n_threads);
+  for (size_t i = 0; i < n_threads; i++) {
+    workers.emplace_back(&ThreadPool::worker, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock{mutex};
+    stop = true;
+  }
+  cv.notify_all();
+  for (auto &th : workers) {
+    th.join();
+  }
+}
+
+void ThreadPool::worker() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock{mutex};
+      cv.wait(lock, [this]() -> bool { return stop || !tasks.empty(); });
+      if (stop && tasks.empty()) {
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+    task();
+  }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// fixed size thread pool, tasks are executed in FIFO order
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t n_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t size() const { return workers.size(); }
+
+  template <typename F> std::future<std::invoke_result_t<F>> submit(F &&f) {
+    using result_t = std::invoke_result_t<F>;
+    // std::function must be copyable, while std::packaged_task is not
+    auto task =
+        std::make_shared<std::packaged_task<result_t()>>(std::forward<F>(f));
+    std::future<result_t> result = task->get_future();
+    {
+      std::lock_guard lock{mutex};
+      tasks.emplace([task]() { (*task)(); });
+    }
+    cv.notify_one();
+    return result;
+  }
+
+private:
+  void worker();
+
+  std::vector<std::thread> workers{};
+  std::queue<std::function<void()>> tasks{};
+  std::mutex mutex{};
+  std::condition_variable cv{};
+  bool stop = false;
+};
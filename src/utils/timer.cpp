@@ -0,0 +1,90 @@
+#include "timer.hpp"
+#include "common.hpp"
+
+TimerRegistry &TimerRegistry::instance() {
+  static TimerRegistry registry;
+  return registry;
+}
+
+TimerRegistry::TimerRegistry() {
+  // the summary is logged from our destructor, the logger must outlive us,
+  // i.e. be constructed first
+  spdlog::default_logger();
+}
+
+TimerRegistry::~TimerRegistry() {
+  stop_logging();
+  log_summary();
+}
+
+size_t TimerRegistry::timer(std::string_view name) {
+  std::lock_guard lock{mutex};
+  for (size_t i = 0; i < names.size(); i++) {
+    if (names[i] == name) {
+      return i;
+    }
+  }
+  names.emplace_back(name);
+  return names.size() - 1;
+}
+
+TimerRegistry::thread_timers &TimerRegistry::local_timers() {
+  thread_local thread_timers *local = [this] {
+    std::lock_guard lock{mutex};
+    threads.push_back(std::make_unique<thread_timers>());
+    return threads.back().get();
+  }();
+  return *local;
+}
+
+std::vector<std::pair<std::string, Histogram>> TimerRegistry::snapshot() {
+  std::lock_guard lock{mutex};
+  std::vector<std::pair<std::string, Histogram>> timers;
+  for (const auto &name : names) {
+    timers.emplace_back(name, Histogram{});
+  }
+  for (const auto &local : threads) {
+    std::lock_guard local_lock{local->mutex};
+    for (size_t i = 0; i < local->histograms.size(); i++) {
+      timers[i].second.merge(local->histograms[i]);
+    }
+  }
+  return timers;
+}
+
+void TimerRegistry::log_summary() {
+  for (const auto &[name, histogram] : snapshot()) {
+    if (histogram.count() == 0) {
+      continue;
+    }
+    INFO("{}: {} calls, mean: {:.1f} us, {}", name, histogram.count(),
+         histogram.mean() / 1e3, histogram.latency_summary());
+  }
+}
+
+void TimerRegistry::log_every(std::chrono::seconds interval) {
+  stop_logging();
+  if (interval.count() == 0) {
+    return;
+  }
+  stop = false;
+  logger = std::thread([this, interval]() {
+    std::unique_lock lock{mutex};
+    while (!stop_cv.wait_for(lock, interval, [this] { return stop; })) {
+      lock.unlock();
+      log_summary();
+      lock.lock();
+    }
+  });
+}
+
+void TimerRegistry::stop_logging() {
+  {
+    std::lock_guard lock{mutex};
+    stop = true;
+  }
+  stop_cv.notify_all();
+  if (logger.joinable()) {
+    logger.join();
+  }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "histogram.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Named timers aggregated into per-thread Histograms of ns durations instead
+// of a log line per measurement. Recording takes an uncontended lock of the
+// calling thread (only a dump competes for it) and one Histogram::record,
+// cheap enough for hot loops. Percentiles since the start are logged on
+// demand, every `interval` with log_every() and at exit.
+class TimerRegistry {
+public:
+  static TimerRegistry &instance();
+  ~TimerRegistry();
+
+  // id of the timer called `name`, registered on first use
+  size_t timer(std::string_view name);
+
+  void record(size_t timer, uint64_t ns) {
+    auto &local = local_timers();
+    std::lock_guard lock{local.mutex};
+    if (timer >= local.histograms.size()) {
+      local.histograms.resize(timer + 1);
+    }
+    local.histograms[timer].record(ns);
+  }
+
+  // merged histograms of all threads, by timer
+  std::vector<std::pair<std::string, Histogram>> snapshot();
+  // one line per timer that recorded anything
+  void log_summary();
+  // log_summary() from a background thread, 0 stops it
+  void log_every(std::chrono::seconds interval);
+
+private:
+  struct alignas(64) thread_timers {
+    std::mutex mutex{};
+    std::vector<Histogram> histograms{};
+  };
+
+  TimerRegistry();
+  thread_timers &local_timers();
+  void stop_logging();
+
+  std::mutex mutex{};
+  std::vector<std::string> names{};
+  // kept after their threads exit
+  std::vector<std::unique_ptr<thread_timers>> threads{};
+
+  std::thread logger{};
+  std::condition_variable stop_cv{};
+  bool stop = false;
+};
+
+class scope_timer {
+public:
+  explicit scope_timer(size_t timer)
+      : timer_{timer}, enter_time_{std::chrono::steady_clock::now()} {}
+
+  ~scope_timer() {
+    TimerRegistry::instance().record(
+        timer_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - enter_time_)
+                    .count());
+  }
+
+private:
+  size_t timer_{};
+  std::chrono::steady_clock::time_point enter_time_{};
+};
+
+#define TIMER_BEGIN(name)                                                      \
+  {                                                                            \
+    static const size_t __timer_id = TimerRegistry::instance().timer(name);    \
+    scope_timer __timer(__timer_id);
+
+#define TIMER_END() }
@@ -0,0 +1,124 @@
+#include "trace.hpp"
+#include "common.hpp"
+
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// all buffers ever created, they outlive their threads so that a dump still
+// shows what exited threads did
+struct trace_registry {
+  std::mutex mutex{};
+  std::vector<std::unique_ptr<TraceBuffer>> buffers{};
+  // reference point to convert trace_clock() ticks into wall time
+  uint64_t base_ticks = trace_clock();
+  std::chrono::steady_clock::time_point base_time =
+      std::chrono::steady_clock::now();
+};
+
+trace_registry &registry() {
+  static trace_registry r;
+  return r;
+}
+
+} // namespace
+
+TraceBuffer &TraceBuffer::local() {
+  thread_local TraceBuffer *buffer = [] {
+    auto &r = registry();
+    std::lock_guard lock{r.mutex};
+    r.buffers.push_back(
+        std::make_unique<TraceBuffer>(static_cast<int>(::syscall(SYS_gettid))));
+    return r.buffers.back().get();
+  }();
+  return *buffer;
+}
+
+std::string dump_chrome_trace() {
+  auto &r = registry();
+  std::lock_guard lock{r.mutex};
+  // ticks per us, measured over the lifetime of the registry
+  uint64_t ticks = trace_clock() - r.base_ticks;
+  double elapsed_us = std::chrono::duration<double, std::micro>(
+                          std::chrono::steady_clock::now() - r.base_time)
+                          .count();
+  double ticks_per_us = elapsed_us > 0 ? ticks / elapsed_us : 1;
+  int pid = ::getpid();
+
+  fmt::memory_buffer out;
+  fmt::format_to(std::back_inserter(out), "{{\"traceEvents\":[");
+  bool first = true;
+  std::vector<trace_event> events;
+  for (const auto &buffer : r.buffers) {
+    uint64_t end = buffer->n_events.load(std::memory_order_acquire);
+    uint64_t begin = end > TraceBuffer::capacity ? end - TraceBuffer::capacity
+                                                 : 0;
+    events.clear();
+    for (uint64_t i = begin; i < end; i++) {
+      events.push_back(buffer->events[i % TraceBuffer::capacity]);
+    }
+    // the owner kept writing while we copied, the oldest slots (including the
+    // one being written right now) may hold newer events now
+    uint64_t now = buffer->n_events.load(std::memory_order_acquire);
+    size_t overwritten =
+        now + 1 - begin > TraceBuffer::capacity
+            ? std::min<size_t>(now + 1 - begin - TraceBuffer::capacity,
+                               events.size())
+            : 0;
+    for (size_t i = overwritten; i < events.size(); i++) {
+      const trace_event &event = events[i];
+      if (event.begin < r.base_ticks) {
+        continue;
+      }
+      fmt::format_to(std::back_inserter(out),
+                     "{}{{\"name\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},"
+                     "\"dur\":{:.3f},\"pid\":{},\"tid\":{}}}",
+                     first ? "" : ",", event.name,
+                     (event.begin - r.base_ticks) / ticks_per_us,
+                     (event.end - event.begin) / ticks_per_us, pid,
+                     buffer->tid);
+      first = false;
+    }
+  }
+  fmt::format_to(std::back_inserter(out), "],\"displayTimeUnit\":\"ns\"}}\n");
+  return fmt::to_string(out);
+}
+
+void dump_trace_on_signal(int signo, std::string path) {
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, signo);
+  int error = pthread_sigmask(SIG_BLOCK, &set, nullptr);
+  if (error) {
+    THROW("{}", get_errno_string(error));
+  }
+#ifndef ENABLE_TRACING
+  INFO("built without ENABLE_TRACING, trace dumps are empty");
+#endif
+  // make sure the reference point is taken before the first event
+  registry();
+  std::thread([set, path = std::move(path)]() {
+    while (true) {
+      int received;
+      if (sigwait(&set, &received) != 0) {
+        continue;
+      }
+      std::ofstream file(path, std::ios::trunc);
+      file << dump_chrome_trace();
+      if (file) {
+        INFO("trace dumped to {}", path);
+      } else {
+        ERROR("can not write trace to {}", path);
+      }
+    }
+  }).detach();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Trace points for finding out where the time of a slow request went.
+// TRACE_SCOPE("name") records the time from the statement to the end of the
+// enclosing scope into a ring buffer of the calling thread, only the last
+// TraceBuffer::capacity events of each thread are kept. Timestamps are raw
+// time stamp counter ticks, converted to wall time only when dumped.
+//
+// Trace points are compiled in with -DENABLE_TRACING (cmake
+// -DENABLE_TRACING=ON) and are empty statements otherwise.
+
+inline uint64_t trace_clock() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+struct trace_event {
+  // a string literal
+  const char *name;
+  uint64_t begin;
+  uint64_t end;
+};
+
+// single producer ring buffer, written by its own thread only. A dump copies
+// the events while they may still be written and drops the ones that were
+// overwritten in the meantime.
+class TraceBuffer {
+public:
+  static constexpr size_t capacity = size_t{1} << 16;
+
+  explicit TraceBuffer(int tid) : tid(tid) {}
+
+  void push(const trace_event &event) {
+    uint64_t n = n_events.load(std::memory_order_relaxed);
+    events[n % capacity] = event;
+    n_events.store(n + 1, std::memory_order_release);
+  }
+
+  // buffer of the calling thread, created on first use
+  static TraceBuffer &local();
+
+private:
+  friend std::string dump_chrome_trace();
+
+  const int tid;
+  std::atomic<uint64_t> n_events{0};
+  std::array<trace_event, capacity> events{};
+};
+
+class trace_scope {
+public:
+  explicit trace_scope(const char *name) : name(name), begin(trace_clock()) {}
+  ~trace_scope() { TraceBuffer::local().push({name, begin, trace_clock()}); }
+
+  trace_scope(const trace_scope &) = delete;
+  trace_scope &operator=(const trace_scope &) = delete;
+
+private:
+  const char *name;
+  uint64_t begin;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef ENABLE_TRACING
+#define TRACE_SCOPE(name)                                                      \
+  trace_scope TRACE_CONCAT(__trace_scope_, __LINE__) { name }
+#else
+#define TRACE_SCOPE(name)                                                      \
+  do {                                                                         \
+  } while (0)
+#endif
+
+// events of all threads in the Chrome trace event format (JSON), to be opened
+// with Perfetto or chrome://tracing
+std::string dump_chrome_trace();
+
+// dump_chrome_trace() into `path` whenever the process receives `signo` (e.g.
+// SIGUSR1). The signal is handled by a dedicated thread with sigwait(2) and
+// blocked in every other thread, call this before any other thread is
+// created, so that they inherit the mask.
+void dump_trace_on_signal(int signo, std::string path);
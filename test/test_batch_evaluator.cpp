@@ -0,0 +1,51 @@
+#include "sync_calculator/batch_evaluator.hpp"
+#include "sync_calculator/evaluator.hpp"
+#include "utils/common.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+// compare BatchEvaluator against the parser on random simple expressions,
+// lengths are chosen so that both the vector body and the scalar tail run
+int main() {
+  std::mt19937 rand(0);
+  std::uniform_int_distribution<int> dist(0, 1 << 20);
+  bool pass = true;
+  for (size_t n : {1, 7, 8, 15, 16, 33, 1000}) {
+    std::vector<std::string> frames;
+    for (size_t i = 0; i < n; i++) {
+      frames.emplace_back(
+          fmt::format("{}{}{}", dist(rand), dist(rand) % 2 ? '*' : '+',
+                      dist(rand) % 1000));
+    }
+    BatchEvaluator batch;
+    for (const auto &frame : frames) {
+      if (!batch.push(frame)) {
+        ERROR("{} is not recognized as simple expression", frame);
+        pass = false;
+      }
+    }
+    const auto &results = batch.flush();
+    for (size_t i = 0; i < n; i++) {
+      int expected = evaluate(frames[i]);
+      if (results[i] != expected) {
+        ERROR("{} = {}, got {}", frames[i], expected, results[i]);
+        pass = false;
+      }
+    }
+  }
+  // general expressions must be rejected
+  for (std::string_view frame :
+       {"(1+2)", "1+2*3", "1234567890+1", "+1", "1+", "12", ""}) {
+    BatchEvaluator batch;
+    if (batch.push(frame)) {
+      ERROR("{} should not be recognized as simple expression", frame);
+      pass = false;
+    }
+  }
+  if (pass) {
+    INFO("pass!");
+  }
+  return pass ? 0 : -1;
+}
@@ -0,0 +1,146 @@
+#include "sync_calculator/codec.hpp"
+#include "utils/buffer.hpp"
+#include "utils/common.hpp"
+#include "utils/connection.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <queue>
+#include <string>
+#include <vector>
+
+// in-memory Stream, reads and writes move at most `chunk` bytes so that
+// headers and bodies are split across calls
+struct MemoryStream {
+  std::string *pipe{};
+  size_t chunk{};
+  size_t offset{};
+
+  int handle() const { return -1; }
+  ssize_t read(char *data, size_t size) {
+    size_t n = std::min({size, chunk, pipe->size() - offset});
+    if (n == 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+    memcpy(data, pipe->data() + offset, n);
+    offset += n;
+    return n;
+  }
+  ssize_t write(const char *data, size_t size) {
+    size_t n = std::min(size, chunk);
+    pipe->append(data, n);
+    return n;
+  }
+};
+
+// the send buffer holds a few frames only, so encode() stops at a full buffer
+template <typename Codec, size_t N = 64>
+using MemoryConnection = Connection<Codec, FixedBuffer<N>, MemoryStream>;
+
+static bool operator==(const ResponseData &a, const ResponseData &b) {
+  return a.value == b.value && a.error == b.error;
+}
+
+// write all `messages` through a Connection and read them back with another
+// one, `chunk` bytes at a time, as `Decoded` copied into `Stored`
+template <typename Codec, typename Message, typename Decoded,
+          typename Stored = Decoded>
+static std::vector<Stored> round_trip(const std::vector<Message> &messages,
+                                      size_t chunk) {
+  std::string pipe;
+  MemoryConnection<Codec> writer{MemoryStream{&pipe, chunk}};
+  MemoryConnection<Codec> reader{MemoryStream{&pipe, chunk}};
+  std::queue<Message> queue;
+  for (const auto &message : messages) {
+    queue.push(message);
+  }
+  while (!queue.empty() || writer.has_pending_writes()) {
+    writer.write(queue);
+  }
+  std::vector<Stored> decoded;
+  while (reader.template read<Decoded>([&](const Decoded &message) {
+    decoded.emplace_back(message);
+  }) != 0) {
+  }
+  return decoded;
+}
+
+template <typename Codec> static bool test_codec() {
+  std::vector<std::string> expressions;
+  std::vector<RequestData> requests;
+  std::vector<ResponseData> responses;
+  for (int i = 0; i < 40; i++) {
+    expressions.push_back(fmt::format("({}+{})*{}", i, i * 7, i % 5));
+    responses.push_back({i * 1000 - 7});
+  }
+  for (const auto &expression : expressions) {
+    requests.push_back({expression});
+  }
+  responses.push_back({0, limit_error::depth});
+  responses.push_back({0, limit_error::tokens});
+  responses.push_back({0, limit_error::steps});
+  responses.push_back({-2147483647});
+
+  bool pass = true;
+  for (size_t chunk : {1, 3, 7, 4096}) {
+    auto decoded_requests =
+        round_trip<Codec, RequestData, std::string_view, std::string>(
+            requests, chunk);
+    if (decoded_requests != expressions) {
+      ERROR("{}: requests differ after a round trip in {} byte chunks",
+            Codec::name, chunk);
+      pass = false;
+    }
+    auto decoded_responses =
+        round_trip<Codec, ResponseData, ResponseData>(responses, chunk);
+    if (decoded_responses != responses) {
+      ERROR("{}: responses differ after a round trip in {} byte chunks",
+            Codec::name, chunk);
+      pass = false;
+    }
+  }
+
+  // a frame larger than the receive buffer can never be decoded
+  std::string pipe;
+  std::string large(100, '1');
+  MemoryConnection<Codec, 256> writer{MemoryStream{&pipe, 4096}};
+  MemoryConnection<Codec> reader{MemoryStream{&pipe, 4096}};
+  std::queue<RequestData> queue;
+  queue.push({large});
+  writer.write(queue);
+  try {
+    while (reader.template read<std::string_view>([](std::string_view) {})) {
+    }
+    ERROR("{}: a frame exceeding the receive buffer is accepted", Codec::name);
+    pass = false;
+  } catch (const recv_error &) {
+  }
+  return pass;
+}
+
+// a binary error frame with a status byte of no limit_error::limit_type
+static bool test_invalid_binary_status() {
+  char frame[header_size + BinaryCodec::response_size]{};
+  set_content_size(frame, {BinaryCodec::response_size});
+  frame[header_size] = 1 + limit_error::steps + 1;
+  try {
+    BinaryCodec::decode<ResponseData>({frame, sizeof(frame)},
+                                      [](const ResponseData &) {});
+  } catch (const program_error &) {
+    return true;
+  }
+  ERROR("binary response with an unknown status is accepted");
+  return false;
+}
+
+int main() {
+  bool pass = test_codec<TextCodec>();
+  pass &= test_codec<BinaryCodec>();
+  pass &= test_codec<BatchCodec>();
+  pass &= test_invalid_binary_status();
+  if (pass) {
+    INFO("pass!");
+  }
+  return pass ? 0 : -1;
+}
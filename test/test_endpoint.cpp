@@ -0,0 +1,73 @@
+#include "utils/client.hpp"
+#include "utils/common.hpp"
+#include "utils/endpoint.hpp"
+#include "utils/server.hpp"
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// send a byte from a Client to a Server at `endpoint` and back
+static bool round_trip(const Endpoint &endpoint) {
+  Server server{endpoint, SocketOptions::preset("low-latency")};
+  server.bind().listen(1);
+  Client client{endpoint, SocketOptions::preset("low-latency")};
+  client.connect();
+  Session session = server.accept();
+  char c = 'x';
+  CHECK(::write(client.handle(), &c, 1));
+  CHECK(::read(session.handle(), &c, 1));
+  CHECK(::write(session.handle(), &c, 1));
+  c = 0;
+  CHECK(::read(client.handle(), &c, 1));
+  INFO("{}, client {}", session, client.local_endpoint());
+  bool pass = c == 'x' && session.local_endpoint() == endpoint;
+  ::close(session.handle());
+  ::close(client.handle());
+  ::close(server.handle());
+  return pass;
+}
+
+// format, compare and round trip IPv4, unix and abstract unix endpoints
+int main() {
+  bool pass = true;
+  auto expect = [&](const Endpoint &endpoint, std::string_view expected) {
+    std::string actual = fmt::format("{}", endpoint);
+    if (actual != expected) {
+      ERROR("expect {}, got {}", expected, actual);
+      pass = false;
+    }
+  };
+  expect(Endpoint{"192.168.1.1", 7814}, "192.168.1.1:7814");
+  expect(Endpoint{7814}, "127.0.0.1:7814");
+  expect(Endpoint::unix_socket("/tmp/calculator.sock"),
+         "unix:/tmp/calculator.sock");
+  expect(Endpoint::unix_socket("@calculator"), "unix:@calculator");
+  pass = pass && Endpoint{7814} == Endpoint{"127.0.0.1", 7814} &&
+         !(Endpoint::unix_socket("@a") == Endpoint::unix_socket("@ab")) &&
+         Endpoint::unix_socket("@a").path() == "@a";
+  try {
+    Endpoint::unix_socket(std::string(200, 'a'));
+    ERROR("accepted a unix socket path over the limit");
+    pass = false;
+  } catch (const program_error &e) {
+    INFO(e.what());
+  }
+
+  fs::path path = fs::temp_directory_path() /
+                  fmt::format("test_endpoint.{}.sock", ::getpid());
+  // bind() replaces the socket file left by the first server
+  pass = pass && round_trip(Endpoint{7817}) &&
+         round_trip(Endpoint::unix_socket(path.string())) &&
+         round_trip(Endpoint::unix_socket(path.string())) &&
+         round_trip(Endpoint::unix_socket(
+             fmt::format("@test_endpoint.{}", ::getpid())));
+  fs::remove(path);
+  if (pass) {
+    INFO("pass!");
+  }
+  return pass ? 0 : -1;
+}
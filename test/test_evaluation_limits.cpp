@@ -0,0 +1,56 @@
+#include "sync_calculator/evaluator.hpp"
+#include "utils/common.hpp"
+
+#include <string>
+
+static bool expect_rejected(std::string_view expression,
+                            limit_error::limit_type type) {
+  try {
+    evaluate(expression);
+  } catch (const limit_error &err) {
+    if (err.type() == type) {
+      return true;
+    }
+    ERROR("{} rejected by {}, expect {}", expression, err.name(),
+          limit_error::type_name(type));
+    return false;
+  }
+  ERROR("{} should be rejected by {}", expression,
+        limit_error::type_name(type));
+  return false;
+}
+
+int main() {
+  bool pass = true;
+  set_evaluation_limits({8, 64, 32});
+
+  std::string nested = "1";
+  for (int i = 0; i < 8; i++) {
+    nested = fmt::format("({})", nested);
+  }
+  pass &= evaluate(nested) == 1;
+  pass &= expect_rejected(fmt::format("({})", nested), limit_error::depth);
+
+  std::string sum = "1";
+  for (int i = 0; i < 15; i++) {
+    sum += "+1";
+  }
+  pass &= evaluate(sum) == 16;
+  pass &= expect_rejected(sum + "+1+1+1+1+1+1+1+1+1+1", limit_error::steps);
+
+  std::string parens = "1";
+  for (int i = 0; i < 40; i++) {
+    parens = fmt::format("({})", parens);
+  }
+  set_evaluation_limits({0, 64, 0});
+  pass &= expect_rejected(parens, limit_error::tokens);
+
+  // limits must not leak into the next expression
+  pass &= evaluate("1+2*3") == 7;
+
+  INFO("{}", get_evaluation_counters());
+  if (pass) {
+    INFO("pass!");
+  }
+  return pass ? 0 : -1;
+}
@@ -0,0 +1,54 @@
+#include "utils/common.hpp"
+#include "utils/histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// compare percentiles of Histogram (and of merged halves) with the exact ones,
+// and check that encode / decode round trips
+int main() {
+  std::mt19937_64 rand(0);
+  std::lognormal_distribution<double> dist(10, 1.5);
+  std::vector<uint64_t> values;
+  Histogram all, odd, even;
+  for (int i = 0; i < 1000000; i++) {
+    uint64_t v = static_cast<uint64_t>(dist(rand));
+    values.push_back(v);
+    all.record(v);
+    (i % 2 ? odd : even).record(v);
+  }
+  odd.merge(even);
+  std::sort(values.begin(), values.end());
+
+  bool pass = all.count() == values.size() && all.max() == values.back() &&
+              all.min() == values.front();
+  double max_error = 1.0 / (1 << (Histogram::sub_bucket_bits - 1));
+  for (double p : {50.0, 90.0, 99.0, 99.9, 100.0}) {
+    size_t rank = static_cast<size_t>(std::ceil(p / 100 * values.size()));
+    uint64_t exact = values[std::max<size_t>(rank, 1) - 1];
+    uint64_t actual = all.value_at_percentile(p);
+    double error = std::abs(static_cast<double>(actual) / exact - 1);
+    INFO("p{}: exact {}, histogram {}, merged {}", p, exact, actual,
+         odd.value_at_percentile(p));
+    if (error > max_error || actual != odd.value_at_percentile(p)) {
+      ERROR("p{} out of bound, relative error {}", p, error);
+      pass = false;
+    }
+  }
+  Histogram decoded = Histogram::decode(all.encode());
+  for (double p : {0.0, 50.0, 99.9, 100.0}) {
+    if (decoded.value_at_percentile(p) != all.value_at_percentile(p)) {
+      ERROR("p{} differs after encode / decode", p);
+      pass = false;
+    }
+  }
+  pass = pass && decoded.count() == all.count() &&
+         decoded.min() == all.min() && decoded.max() == all.max();
+  INFO("{}", all.latency_summary());
+  if (pass) {
+    INFO("pass!");
+  }
+  return pass ? 0 : -1;
+}
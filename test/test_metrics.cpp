@@ -0,0 +1,92 @@
+#include "utils/client.hpp"
+#include "utils/common.hpp"
+#include "utils/metrics.hpp"
+
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+// record from several threads and check the aggregated values in a scrape
+// served by MetricsServer
+int main() {
+  auto &registry = MetricsRegistry::instance();
+  Counter requests = registry.counter("test_requests_total", "Requests.");
+  Counter get = registry.counter("test_methods_total", "Requests by method.",
+                                 "method=\"get\"");
+  Counter put = registry.counter("test_methods_total", "Requests by method.",
+                                 "method=\"put\"");
+  get.add(2);
+  put.add(3);
+  Gauge in_flight = registry.gauge("test_in_flight", "In flight requests.");
+  TimeHistogram latency =
+      registry.histogram("test_latency_seconds", "Request latency.");
+
+  constexpr int n_threads = 4;
+  constexpr int n_records = 100000;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < n_threads; i++) {
+    threads.emplace_back([&, i]() {
+      for (int j = 0; j < n_records; j++) {
+        requests.add();
+        latency.record(j % 2 ? 100 : 1000);
+      }
+      in_flight.set(i);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  MetricsServer server("127.0.0.1", 7815);
+  Client client{"127.0.0.1", 7815};
+  client.connect();
+  std::string_view request = "GET /metrics HTTP/1.0\r\n\r\n";
+  CHECK(write(client.handle(), request.data(), request.size()));
+  std::string response;
+  std::array<char, 4096> buffer;
+  ssize_t n;
+  while ((n = read(client.handle(), buffer.data(), buffer.size())) > 0) {
+    response.append(buffer.data(), n);
+  }
+  close(client.handle());
+
+  int total = n_threads * n_records;
+  bool pass = true;
+  for (const std::string &expected : std::vector<std::string>{
+           "HTTP/1.0 200 OK\r\n",
+           "# TYPE test_requests_total counter\n",
+           fmt::format("\ntest_requests_total {}\n", total),
+           "# TYPE test_methods_total counter\n"
+           "test_methods_total{method=\"get\"} 2\n"
+           "test_methods_total{method=\"put\"} 3\n",
+           "\ntest_in_flight 6\n",
+           "# TYPE test_latency_seconds histogram\n",
+           fmt::format("\ntest_latency_seconds_bucket{{le=\"2.56e-07\"}} {}\n",
+                       total / 2),
+           fmt::format("\ntest_latency_seconds_bucket{{le=\"1.024e-06\"}} {}\n",
+                       total),
+           fmt::format("\ntest_latency_seconds_bucket{{le=\"+Inf\"}} {}\n",
+                       total),
+           fmt::format("\ntest_latency_seconds_count {}\n", total),
+       }) {
+    if (response.find(expected) == std::string::npos) {
+      ERROR("missing {}", escaped(expected));
+      pass = false;
+    }
+  }
+  if (MetricsRegistry::bucket_of(0) != 0 ||
+      MetricsRegistry::bucket_of(256) != 0 ||
+      MetricsRegistry::bucket_of(257) != 1 ||
+      MetricsRegistry::bucket_of(~uint64_t{0}) !=
+          MetricsRegistry::n_buckets - 1) {
+    ERROR("wrong bucket");
+    pass = false;
+  }
+  if (pass) {
+    INFO("pass!");
+  } else {
+    INFO("{}", response);
+  }
+  return pass ? 0 : -1;
+}
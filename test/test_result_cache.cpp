@@ -0,0 +1,98 @@
+#include "sync_calculator/result_cache.hpp"
+#include "utils/common.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+static const fs::path cache_file =
+    fs::temp_directory_path() / "test_result_cache.bin";
+
+static bool expect(bool condition, std::string_view what) {
+  if (!condition) {
+    ERROR("{}", what);
+  }
+  return condition;
+}
+
+int main() {
+  bool pass = true;
+  fs::remove(cache_file);
+  {
+    ResultCache cache(cache_file, 1000);
+    pass &= expect(cache.capacity() == 1024, "capacity is rounded up");
+    pass &= expect(!cache.find("1+2*3"), "fresh cache is empty");
+    cache.insert("1+2*3", 7);
+    cache.insert("(1+2)*3", 9);
+    cache.insert("1+2*3", 7);
+    pass &= expect(cache.find("1+2*3") == 7 && cache.find("(1+2)*3") == 9,
+                   "find returns the inserted values");
+    pass &= expect(cache.size() == 2, "reinserting does not add an entry");
+  }
+  {
+    ResultCache cache(cache_file, 1000);
+    pass &= expect(cache.size() == 2 && cache.find("1+2*3") == 7 &&
+                       cache.find("(1+2)*3") == 9,
+                   "entries survive a reopen");
+  }
+  {
+    ResultCache cache(cache_file, 1000, {8, 64, 32});
+    pass &= expect(cache.size() == 0 && !cache.find("1+2*3"),
+                   "other evaluation limits reinitialize the cache");
+    cache.insert("1+2*3", 7);
+  }
+  {
+    ResultCache cache(cache_file, 4096, {8, 64, 32});
+    pass &= expect(cache.size() == 0 && !cache.find("1+2*3"),
+                   "another capacity reinitializes the cache");
+    cache.insert("1+2*3", 7);
+  }
+  {
+    // clobber the magic
+    int fd;
+    CHECK(fd = ::open(cache_file.c_str(), O_WRONLY));
+    CHECK(::pwrite(fd, "XXXXXXXX", 8, 0));
+    ::close(fd);
+    ResultCache cache(cache_file, 4096, {8, 64, 32});
+    pass &= expect(cache.size() == 0 && !cache.find("1+2*3"),
+                   "another format reinitializes the cache");
+  }
+  fs::remove(cache_file);
+  {
+    // same length and the same FNV-1a hash (0x5cdf4c58dddb233e)
+    std::string_view a = "03082aa99bbeff05";
+    std::string_view b = "c739d0f4aae98daf";
+    ResultCache cache(cache_file, 16);
+    cache.insert(a, 1);
+    pass &= expect(!cache.find(b), "a colliding expression is a miss");
+    cache.insert(b, 2);
+    pass &= expect(cache.find(a) == 1 && cache.find(b) == 2,
+                   "colliding expressions keep their own values");
+  }
+  fs::remove(cache_file);
+  {
+    // 4 slots and a 256 bytes arena, cleared every few insertions
+    ResultCache cache(cache_file, 4);
+    bool consistent = true;
+    for (int i = 0; i < 200; i++) {
+      std::string expression = fmt::format("{}+{}*{}", i, i, i);
+      cache.insert(expression, i);
+      consistent &= cache.find(expression) == i;
+      for (int j = std::max(0, i - 8); j < i; j++) {
+        auto value = cache.find(fmt::format("{}+{}*{}", j, j, j));
+        consistent &= !value || *value == j;
+      }
+    }
+    pass &= expect(consistent && cache.size() <= cache.capacity(),
+                   "a full arena never yields wrong values");
+  }
+  fs::remove(cache_file);
+  if (pass) {
+    INFO("pass!");
+  }
+  return pass ? 0 : -1;
+}
@@ -0,0 +1,118 @@
+#include "utils/common.hpp"
+#include "utils/shm_channel.hpp"
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+
+// wait until `channel` may make progress, the peer is never idle here, so a
+// timeout means a lost wake up
+static void wait(const ShmChannel &channel) {
+  pollfd fd{channel.handle(), POLLIN, 0};
+  int n_ready;
+  CHECK(n_ready = ::poll(&fd, 1, 1000));
+  if (n_ready == 0) {
+    THROW("no wake up within 1 s");
+  }
+}
+
+// echo everything back until the server closed its end
+static int echo(int sock_fd) {
+  ShmChannel channel = ShmChannel::connect(sock_fd);
+  std::string pending;
+  char buffer[1000];
+  while (true) {
+    ssize_t n = channel.read(buffer, sizeof(buffer));
+    if (n == 0) {
+      return pending.empty() ? 0 : -1;
+    }
+    if (n > 0) {
+      pending.append(buffer, n);
+    }
+    ssize_t written = channel.write(pending.data(), pending.size());
+    if (written > 0) {
+      pending.erase(0, written);
+    }
+    if (n == -1 && written <= 0) {
+      wait(channel);
+    }
+  }
+}
+
+// try_connect() on a non-blocking socket, before and after the server passed
+// the channel
+static bool test_try_connect() {
+  int fds[2];
+  CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+  bool pass = !ShmChannel::try_connect(fds[1]);
+  ShmChannel server = ShmChannel::accept(fds[0], 4096);
+  std::optional<ShmChannel> client = ShmChannel::try_connect(fds[1]);
+  pass = pass && client && client->write("1+2", 3) == 3;
+  char buffer[4];
+  pass = pass && server.read(buffer, sizeof(buffer)) == 3;
+  ::close(fds[0]);
+  ::close(fds[1]);
+  if (!pass) {
+    ERROR("try_connect failed");
+  }
+  return pass;
+}
+
+// send 1 MiB through rings of 4 KiB (so that they wrap and fill up) to a
+// forked client, which echoes it back
+int main() {
+  if (!test_try_connect()) {
+    return -1;
+  }
+  int fds[2];
+  CHECK(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  pid_t pid;
+  CHECK(pid = ::fork());
+  if (pid == 0) {
+    ::close(fds[0]);
+    _exit(echo(fds[1]));
+  }
+  ::close(fds[1]);
+
+  std::string sent;
+  for (int i = 0; sent.size() < (1 << 20); i++) {
+    sent += std::to_string(i) + ",";
+  }
+  std::string received;
+  {
+    ShmChannel channel = ShmChannel::accept(fds[0], 4096);
+    size_t offset = 0;
+    char buffer[1500];
+    while (received.size() < sent.size()) {
+      ssize_t written = channel.write(sent.data() + offset,
+                                      std::min<size_t>(sent.size() - offset,
+                                                       3000));
+      if (written > 0) {
+        offset += written;
+      }
+      ssize_t n = channel.read(buffer, sizeof(buffer));
+      if (n == 0) {
+        ERROR("client closed early");
+        break;
+      }
+      if (n > 0) {
+        received.append(buffer, n);
+      }
+      if (n == -1 && written <= 0) {
+        wait(channel);
+      }
+    }
+  }
+  int status;
+  CHECK(::waitpid(pid, &status, 0));
+  bool pass = received == sent && WIFEXITED(status) &&
+              WEXITSTATUS(status) == 0;
+  INFO("echoed {} bytes, client exit status {}", received.size(), status);
+  ::close(fds[0]);
+  if (pass) {
+    INFO("pass!");
+  }
+  return pass ? 0 : -1;
+}
@@ -2,6 +2,7 @@
 #include "spdlog/spdlog.h"
 #include "sync_calculator/requester.hpp"
 #include "sync_calculator/responser.hpp"
+#include "sync_calculator/workload.hpp"
 #include "utils/client.hpp"
 #include "utils/common.hpp"
 #include "utils/server.hpp"
@@ -25,6 +26,11 @@ void client(std::string_view server_ip, uint16_t server_port) {
   }
 
   Requester req{c.handle()};
+  // 50 requests, no need for the default million keys
+  workload_profile profile;
+  profile.keys = 64;
+  GeneratedWorkload workload{profile, 0};
+  WorkloadStream stream{workload, 0};
 
   bool pass = true;
 
@@ -33,7 +39,7 @@ void client(std::string_view server_ip, uint16_t server_port) {
     while (count-- > 0) {
       // 一次发10个请求
       for (int i = 0; i < 10; i++) {
-        req.do_request();
+        req.do_request(stream.next());
         req.do_write();
       }
       req.do_read();